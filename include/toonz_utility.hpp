@@ -9,12 +9,22 @@
 
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <algorithm>
 #include <array>
 #include <limits>
 #include <random>
 #include <thread>
 #include <sstream>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -33,29 +43,101 @@
 #ifdef _WIN32
 #define NOMINMAX
 #include <Windows.h>
-#define DEBUG_PRINT(MSG)                                        \
-  do {                                                          \
-    std::ostringstream out;                                     \
-    out << "[" << tnzu::plugin_info()->name << " ("             \
-        << std::this_thread::get_id() << ")]: " << MSG << '\n'; \
-    OutputDebugStringA(out.str().c_str());                      \
-} while (0)
+#endif
+
+// log levels. messages above TNZU_LOG_LEVEL are compiled out, and those above
+// tnzu::log_level() are skipped at run time.
+#define TNZU_LOG_LEVEL_NONE 0
+#define TNZU_LOG_LEVEL_ERROR 1
+#define TNZU_LOG_LEVEL_WARNING 2
+#define TNZU_LOG_LEVEL_INFO 3
+#define TNZU_LOG_LEVEL_DEBUG 4
+
+#ifndef TNZU_LOG_LEVEL
+#ifdef NDEBUG
+#define TNZU_LOG_LEVEL TNZU_LOG_LEVEL_WARNING
 #else
-#define DEBUG_PRINT(MSG)     \
-  do {                       \
-    std::ostringstream out;  \
-    out << MSG;              \
-    puts(out.str().c_str()); \
-} while (0)
+#define TNZU_LOG_LEVEL TNZU_LOG_LEVEL_DEBUG
+#endif
 #endif
 
+#define TNZU_LOG(LEVEL, MSG)                \
+  do {                                      \
+    if (tnzu::log_level() >= (LEVEL)) {     \
+      std::ostringstream out;               \
+      out << MSG;                           \
+      tnzu::write_log((LEVEL), out.str());  \
+    }                                       \
+  } while (0)
+
+// keeps `MSG` compiled, but never evaluated
+#define TNZU_LOG_DISABLED(MSG)   \
+  do {                           \
+    if (false) {                 \
+      std::ostringstream out;    \
+      out << MSG;                \
+    }                            \
+  } while (0)
+
+#if TNZU_LOG_LEVEL >= TNZU_LOG_LEVEL_ERROR
+#define TNZU_LOG_ERROR(MSG) TNZU_LOG(TNZU_LOG_LEVEL_ERROR, MSG)
+#else
+#define TNZU_LOG_ERROR(MSG) TNZU_LOG_DISABLED(MSG)
+#endif
+
+#if TNZU_LOG_LEVEL >= TNZU_LOG_LEVEL_WARNING
+#define TNZU_LOG_WARNING(MSG) TNZU_LOG(TNZU_LOG_LEVEL_WARNING, MSG)
+#else
+#define TNZU_LOG_WARNING(MSG) TNZU_LOG_DISABLED(MSG)
+#endif
+
+#if TNZU_LOG_LEVEL >= TNZU_LOG_LEVEL_INFO
+#define TNZU_LOG_INFO(MSG) TNZU_LOG(TNZU_LOG_LEVEL_INFO, MSG)
+#else
+#define TNZU_LOG_INFO(MSG) TNZU_LOG_DISABLED(MSG)
+#endif
+
+#if TNZU_LOG_LEVEL >= TNZU_LOG_LEVEL_DEBUG
+#define TNZU_LOG_DEBUG(MSG) TNZU_LOG(TNZU_LOG_LEVEL_DEBUG, MSG)
+#else
+#define TNZU_LOG_DEBUG(MSG) TNZU_LOG_DISABLED(MSG)
+#endif
+
+#define DEBUG_PRINT(MSG) TNZU_LOG_DEBUG(MSG)
+
 #define TNZU_PP_STR_(X) #X
 #define TNZU_PP_STR(X) TNZU_PP_STR_(X)
+#define TNZU_PP_CAT_(X, Y) X##Y
+#define TNZU_PP_CAT(X, Y) TNZU_PP_CAT_(X, Y)
+
+// times the rest of the enclosing block, cf. tnzu::TraceSpan
+#ifndef TNZU_ENABLE_TRACE
+#define TNZU_ENABLE_TRACE 1
+#endif
+
+#if TNZU_ENABLE_TRACE
+#define TNZU_TRACE_SPAN(NAME) \
+  tnzu::TraceSpan const TNZU_PP_CAT(tnzu_trace_span_, __LINE__)(NAME)
+#else
+#define TNZU_TRACE_SPAN(NAME) \
+  do {                        \
+  } while (0)
+#endif
 
 namespace tnzu {
 template <typename T>
 struct opencv_type_traits;
 
+template <>
+struct opencv_type_traits<cv::Vec4b> {
+  static int const value = CV_8UC4;
+};
+
+template <>
+struct opencv_type_traits<cv::Vec4w> {
+  static int const value = CV_16UC4;
+};
+
 template <>
 struct opencv_type_traits<float> {
   static int const value = CV_32FC1;
@@ -110,6 +192,9 @@ inline T to_nonlinear_color_space(T linear_color, T exposure, T gamma) {
   return std::pow(T(1) - std::exp(-exposure * linear_color), T(1) / gamma);
 }
 
+// lookup tables between BitDepth-bit channel values and the power space.
+// tables are shared by converters of the same exposure and gamma. exposure 0
+// selects the plain power law v^gamma of Fx::PIXEL_FORMAT_LINEAR.
 template <std::size_t BitDepth, typename T = float>
 class linear_color_space_converter {
  public:
@@ -118,20 +203,157 @@ class linear_color_space_converter {
 
  public:
   inline linear_color_space_converter(T exposure, T gamma)
-      : table_(new T[Size]) {
-    T const scale = T(1) / Size;
-    for (int i = 0; i < Size; i++) {
-      table_[i] =
-          tnzu::to_linear_color_space((i + T(0.5)) * scale, exposure, gamma);
-    }
+      : tables_(acquire(exposure, gamma)) {}
+
+  inline T operator[](int value) const { return tables_->forward[value]; }
+
+  // nonlinear color in [0, 1] of `linear_color`, interpolated from a table
+  // of 256 samples per octave
+  inline T inverse(T linear_color) const;
+
+  // channel value of `linear_color`, inverse of operator[]
+  inline int quantize(T linear_color) const {
+    Tables const& t = *tables_;
+    int const value =
+        static_cast<int>(inverse(linear_color) * t.levels + t.rounding);
+    return std::min(std::max(value, 0), int(Size - 1));
   }
 
-  inline T operator[](int value) const { return table_[value]; }
+  // converts an image of channel values (CV_8U up to 8 bits, CV_16U up to 16
+  // bits) to the power space of T. alpha of 4 channel images is normalized.
+  void to_linear(cv::Mat const& src, cv::Mat& dst) const;
+
+  // converts an image of the power space to channel values
+  void to_nonlinear(cv::Mat const& src, cv::Mat& dst) const;
 
  private:
-  std::unique_ptr<T[]> table_;
+  struct Tables {
+    T exposure;
+    T gamma;
+    // channel values v are sampled at (v + 0.5 - rounding) / levels
+    T levels;
+    T rounding;
+    std::unique_ptr<T[]> forward;
+    std::vector<T> backward;  // samples at 2^(min_exp + i / 256)
+    int min_exp;
+    float min_linear;
+    float max_linear;
+  };
+
+  static std::shared_ptr<Tables const> acquire(T exposure, T gamma);
+
+  static double forward_value(double v, double exposure, double gamma) {
+    return (exposure == 0) ? std::pow(v, gamma)
+                           : tnzu::to_linear_color_space(v, exposure, gamma);
+  }
+
+  static double backward_value(double v, double exposure, double gamma) {
+    return (exposure == 0)
+               ? std::pow(v, 1.0 / gamma)
+               : tnzu::to_nonlinear_color_space(v, exposure, gamma);
+  }
+
+  std::shared_ptr<Tables const> tables_;
 };
 
+template <std::size_t BitDepth, typename T>
+auto linear_color_space_converter<BitDepth, T>::acquire(T exposure, T gamma)
+    -> std::shared_ptr<Tables const> {
+  // unused tables are released when the registry grows beyond this
+  std::size_t const capacity = 16;
+
+  static std::mutex mutex;
+  static std::map<std::pair<T, T>, std::shared_ptr<Tables const>> registry;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto const key = std::make_pair(exposure, gamma);
+  auto const it = registry.find(key);
+  if (it != registry.end()) {
+    return it->second;
+  }
+
+  if (registry.size() >= capacity) {
+    for (auto i = registry.begin(); i != registry.end();) {
+      if (i->second.use_count() == 1) {
+        i = registry.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  std::shared_ptr<Tables> tables = std::make_shared<Tables>();
+  tables->exposure = exposure;
+  tables->gamma = gamma;
+
+  // centers of bins of the power space, and ends of [0, 1] for the power law
+  // so that 0 and the maximum map to 0 and 1 as PIXEL_FORMAT_FLOAT
+  tables->levels = (exposure == 0) ? T(Size - 1) : T(Size);
+  tables->rounding = (exposure == 0) ? T(0.5) : T(0);
+
+  // in double, since 1 - pow(v, gamma) of small values vanishes in float
+  tables->forward.reset(new T[Size]);
+  double const scale = 1.0 / tables->levels;
+  double const offset = 0.5 - tables->rounding;
+  for (std::size_t i = 0; i < Size; i++) {
+    tables->forward[i] =
+        static_cast<T>(forward_value((i + offset) * scale, exposure, gamma));
+  }
+
+  // covers the forward table with a margin of an octave
+  float const lo = static_cast<float>(
+      (tables->forward[0] > 0) ? tables->forward[0] : tables->forward[1]);
+  float const hi = static_cast<float>(tables->forward[Size - 1]);
+  tables->min_exp = 0;
+  tables->min_linear = 0;
+  tables->max_linear = 0;
+  if ((lo > 0) && std::isfinite(hi)) {
+    int const min_exp = static_cast<int>(std::floor(std::log2(lo))) - 1;
+    int const max_exp = static_cast<int>(std::ceil(std::log2(hi))) + 1;
+    tables->min_exp = min_exp;
+    tables->min_linear = std::ldexp(1.0f, min_exp);
+    tables->max_linear = std::ldexp(1.0f, max_exp);
+
+    tables->backward.resize((max_exp - min_exp) * 256 + 1);
+    for (std::size_t i = 0; i < tables->backward.size(); i++) {
+      int const octave = min_exp + static_cast<int>(i / 256);
+      double const linear = std::ldexp(1.0 + (i % 256) / 256.0, octave);
+      tables->backward[i] =
+          static_cast<T>(backward_value(linear, exposure, gamma));
+    }
+  }
+
+  registry[key] = tables;
+  return tables;
+}
+
+template <std::size_t BitDepth, typename T>
+inline T linear_color_space_converter<BitDepth, T>::inverse(
+    T linear_color) const {
+  Tables const& t = *tables_;
+
+  float const value = static_cast<float>(linear_color);
+  if (!(value > 0)) {
+    return T(0);
+  }
+  if (!(value > t.min_linear) || !(value < t.max_linear)) {
+    // out of the table
+    return static_cast<T>(backward_value(
+        std::max<double>(linear_color, 0.0), t.exposure, t.gamma));
+  }
+
+  // exponents and the top 8 bits of mantissas index the table
+  std::uint32_t bits, min_bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  std::memcpy(&min_bits, &t.min_linear, sizeof(min_bits));
+  std::uint32_t const offset = bits - min_bits;
+  std::size_t const i = offset >> 15;
+  T const f = T(offset & 0x7fff) / 0x8000;
+
+  return t.backward[i] + (t.backward[i + 1] - t.backward[i]) * f;
+}
+
 template <typename T>
 inline T lerp(T const& a, T const& b, double t) {
   return a + (b - a) * t;
@@ -233,8 +455,38 @@ struct PluginInfo {
 
 extern PluginInfo const* plugin_info();
 
+// an array of a size fixed at construction. up to `N` elements are stored in
+// the object, so that small arrays are never allocated on the heap.
+template <typename T, std::size_t N>
+class small_array {
+ public:
+  explicit small_array(std::size_t n, T const& value = T()) : size_(n) {
+    if (n > N) {
+      heap_.assign(n, value);
+    } else {
+      std::fill_n(inline_.begin(), n, value);
+    }
+  }
+
+  std::size_t size() const { return size_; }
+
+  T* data() { return (size_ > N) ? heap_.data() : inline_.data(); }
+  T const* data() const { return (size_ > N) ? heap_.data() : inline_.data(); }
+
+  T& operator[](std::size_t i) { return data()[i]; }
+  T const& operator[](std::size_t i) const { return data()[i]; }
+
+ private:
+  std::size_t size_;
+  std::array<T, N> inline_;
+  std::vector<T> heap_;
+};
+
+class Bloom;
+
 class Fx {
  public:
+  Fx();
   virtual ~Fx();
 
   static std::string get_stuff_dir();
@@ -257,9 +509,23 @@ class Fx {
   virtual int param_count() const = 0;
   virtual ParamPrototype const* param_prototype(int i) const = 0;
 
+  // formats of inputs and results exchanged with compute()
+  enum PixelFormat {
+    // CV_8UC4 or CV_16UC4 of the tile
+    PIXEL_FORMAT_NATIVE,
+    // CV_32FC4 normalized to [0, 1]
+    PIXEL_FORMAT_FLOAT,
+    // CV_32FC4 normalized to [0, 1], whose straight colors are raised to
+    // Config::gamma and premultiplied again. alpha is kept as is.
+    PIXEL_FORMAT_LINEAR,
+    // CV_32FC1 of the blue, green, red and alpha planes stacked vertically,
+    // normalized to [0, 1]. cf. tnzu::plane()
+    PIXEL_FORMAT_PLANAR,
+  };
+
   class Params {
    public:
-    inline Params(int paramc) : params_(paramc) {}
+    inline Params(int paramc) : params_(paramc, 0.0) {}
 
     inline double operator[](std::size_t const i) const { return params_[i]; }
     inline double& operator[](std::size_t const i) { return params_[i]; }
@@ -283,41 +549,59 @@ class Fx {
     inline std::mt19937_64 rng(int i) const;
 
    private:
-    std::vector<double> params_;
+    small_array<double, 32> params_;
   };
 
   class Args {
    public:
-    inline Args(int argc) : valid_(argc, false), args_(argc), offsets_(argc) {}
-
-    inline void set(std::size_t i, cv::Mat arg, cv::Point2d offset) {
-      valid_[i] = true;
-      args_[i] = arg;
-      offsets_[i] = offset;
+    inline Args(int argc) : args_(argc) {}
+
+    inline void set(std::size_t i, cv::Mat arg, cv::Point2d offset,
+                    PixelFormat format = PIXEL_FORMAT_NATIVE) {
+      Arg& a = args_[i];
+      a.valid = true;
+      a.mat = arg;
+      a.offset = offset;
+      a.format = format;
     }
 
    public:
     int count() const { return static_cast<int>(args_.size()); }
 
-    inline bool valid(std::size_t i) const { return valid_[i]; }
-    inline bool invalid(std::size_t i) const { return !valid_[i]; }
+    inline bool valid(std::size_t i) const { return args_[i].valid; }
+    inline bool invalid(std::size_t i) const { return !args_[i].valid; }
 
-    inline cv::Mat const& get(std::size_t i) const { return args_[i]; }
+    inline cv::Mat const& get(std::size_t i) const { return args_[i].mat; }
 
-    inline cv::Point2d offset(std::size_t i) const { return offsets_[i]; }
+    inline cv::Point2d offset(std::size_t i) const { return args_[i].offset; }
 
-    inline cv::Size2d size(std::size_t i) const { return args_[i].size(); }
+    inline PixelFormat format(std::size_t i) const { return args_[i].format; }
+
+    inline cv::Size2d size(std::size_t i) const {
+      cv::Mat const& mat = args_[i].mat;
+      if (args_[i].format == PIXEL_FORMAT_PLANAR) {
+        return cv::Size2d(mat.cols, mat.rows / 4);
+      }
+      return mat.size();
+    }
 
     inline cv::Rect2d rect(std::size_t i) const {
       return cv::Rect2d(offset(i), size(i));
     }
 
-    inline cv::Point2d& offset(std::size_t i) { return offsets_[i]; }
+    inline cv::Point2d& offset(std::size_t i) { return args_[i].offset; }
 
    private:
-    std::vector<bool> valid_;
-    std::vector<cv::Mat> args_;
-    std::vector<cv::Point2d> offsets_;
+    struct Arg {
+      Arg() : valid(false), format(PIXEL_FORMAT_NATIVE) {}
+
+      bool valid;
+      cv::Mat mat;
+      cv::Point2d offset;
+      PixelFormat format;
+    };
+
+    small_array<Arg, 4> args_;
   };
 
   // cf. toonz::rendering_setting_t
@@ -337,6 +621,13 @@ class Fx {
     int apply_shrink_to_viewer;
 
     int frame;
+
+    // position of retimg(0, 0) in the output space, set for compute()
+    cv::Point2d origin;
+
+    // resolution of the output space relative to the requested one. it is
+    // less than 1 while a proxy is computed, cf. proxy_scale()
+    double scale;
   };
 
  public:
@@ -350,15 +641,93 @@ class Fx {
 
   virtual int enlarge(Config const& config, Params const& params,
                       cv::Rect2d& retrc);
+  // inverse of enlarge: `retrc` is initialized by a region of the result,
+  // and is set to the region of inputs required to compute it.
+  // the default requires whole inputs.
+  virtual int require(Config const& config, Params const& params,
+                      cv::Rect2d& retrc);
   virtual int compute(Config const& config, Params const& params,
                       Args const& args, cv::Mat& retimg) = 0;
 
+  // estimated bytes of memory used to compute the result from `rect` of
+  // inputs, the default counts inputs, a result and scratch buffers
+  virtual std::size_t memory_requirement(Config const& config,
+                                         Params const& params,
+                                         cv::Rect2d const& rect);
+
+  // format of the input `i` passed to compute(). inputs are converted from
+  // tiles once while they are read.
+  virtual PixelFormat port_format(int i) const;
+
+  // format of `retimg` of compute(), converted to the tile while written
+  virtual PixelFormat output_format() const;
+
+  // number of temporary images as large as the result used by compute()
+  virtual int scratch_buffer_count() const;
+
+  // splits a tile into sub-tiles which fit in Config::max_tile_size, and
+  // computes them in parallel. `retimg` of a sub-tile covers only its part
+  // of the tile, so inputs may lie partly outside of it. tiles are split
+  // only when require() asks for less than whole inputs.
+  virtual bool use_subtiles() const;
+
+  // maximum number of input ports computed concurrently by upstream nodes.
+  // 1 computes them one by one, 0 lets the library decide.
+  virtual int input_concurrency() const;
+
+  // bytes of results cached for the node. a cached result is reused when
+  // parameters, a configuration, a region and inputs are all the same.
+  // 0 disables the cache.
+  virtual std::size_t cache_budget() const;
+
+  // resolution at which a tile is computed, relative to `config`. below 1,
+  // inputs and the result are rendered as a smaller proxy, whose scale is
+  // given by Config::scale, and it is upsampled to the tile. the default 1
+  // always computes at full resolution.
+  virtual double proxy_scale(Config const& config) const;
+
+  // whether the parameter `i` is a length in pixels, which is multiplied by
+  // Config::scale for compute()
+  virtual bool param_spatial(int i) const;
+
+  // bytes of objects kept by persistent(), 256 MiB by default
+  virtual std::size_t persistent_budget() const;
+
  public:
   inline toonz::node_handle_t handle() const { return handle_; }
   inline toonz::node_handle_t& handle() { return handle_; }
 
+  // a bloom engine of the node. its buffers are reused by later calls until
+  // end_render, so blooms of the same size allocate nothing. an engine
+  // released after the node is deleted is deleted with it.
+  std::shared_ptr<Bloom> bloom() const;
+
+  // an object of the node kept across frames under `key`, such as a kernel
+  // or a noise field. `make()` returns a new T when the node has none, or
+  // when any of the parameters `deps` has changed since it was made.
+  // concurrent calls for a key wait for one `make()`. objects are released
+  // in end_render, or least recently used first beyond persistent_budget(),
+  // which counts the bytes footprint(T const&) returns for each object.
+  template <typename T, typename F>
+  std::shared_ptr<T const> persistent(std::string const& key,
+                                      Params const& params,
+                                      std::initializer_list<int> deps,
+                                      F make) const;
+
+  // type-erased persistent(). `make(bytes)` sets the size of the object.
+  std::shared_ptr<void const> persistent(
+      std::string const& key, std::type_info const& type,
+      std::vector<double> const& values,
+      std::function<std::shared_ptr<void const>(std::size_t&)> const& make)
+      const;
+
+  // library-owned state of the node
+  struct State;
+  inline State* state() const { return state_.get(); }
+
  public:
   toonz::node_handle_t handle_;
+  std::shared_ptr<State> state_;
 };
 
 template <typename T>
@@ -386,6 +755,41 @@ inline int Fx::Params::get(int i, double scale) const {
   return static_cast<int>(std::round(params_[i] * scale));
 }
 
+// bytes of an object kept by Fx::persistent(). other types kept by it
+// declare their own footprint() beside them, which is found by lookup of
+// their namespace, so that the budget counts the memory they own.
+inline std::size_t footprint(cv::Mat const& mat) {
+  return mat.total() * mat.elemSize();
+}
+
+inline std::size_t footprint(std::vector<cv::Mat> const& mats) {
+  std::size_t bytes = 0;
+  for (cv::Mat const& mat : mats) {
+    bytes += footprint(mat);
+  }
+  return bytes;
+}
+
+template <typename T, typename F>
+std::shared_ptr<T const> Fx::persistent(std::string const& key,
+                                        Params const& params,
+                                        std::initializer_list<int> deps,
+                                        F make) const {
+  std::vector<double> values;
+  values.reserve(deps.size());
+  for (int i : deps) {
+    values.push_back(params[i]);
+  }
+
+  return std::static_pointer_cast<T const>(persistent(
+      key, typeid(T), values,
+      [&make](std::size_t& bytes) -> std::shared_ptr<void const> {
+        std::shared_ptr<T const> const object = std::make_shared<T>(make());
+        bytes = footprint(*object);
+        return object;
+      }));
+}
+
 template <typename T>
 inline T Fx::Params::radian(int i) const {
   return static_cast<T>(tnzu::to_radian<double>(params_[i]));
@@ -404,6 +808,12 @@ inline std::mt19937_64 Fx::Params::rng(int i) const {
 }
 
 extern Fx* make_fx();
+
+// the plane `c` of an image of Fx::PIXEL_FORMAT_PLANAR
+inline cv::Mat plane(cv::Mat const& img, int c) {
+  int const rows = img.rows / 4;
+  return img.rowRange(rows * c, rows * (c + 1));
+}
 }
 
 namespace tnzu {
@@ -426,9 +836,348 @@ inline bool file_exists(char const* file_name) {
   }
 }
 
-// hash code
+// hash code of whole contents, type and size. bands of rows are hashed in
+// parallel, four at a time by the SIMD variant in use
 std::size_t hash(cv::Mat const& m);
 
+// hash code of a sub-rectangle
+std::size_t hash(cv::Mat const& m, cv::Rect const& roi);
+
+// hash code of 256 sampled bytes, which is fast but may equal for
+// different images
+std::size_t probable_hash(cv::Mat const& m);
+
+// incremental 64-bit hash (xxHash64)
+class Hasher {
+ public:
+  explicit Hasher(std::uint64_t seed = 0);
+
+  void update(void const* data, std::size_t size);
+  void update(cv::Mat const& m);
+
+  // updates four hashers by `size` bytes of data[i] each, whose lanes run
+  // together by SIMD. the hashers must have taken the same number of bytes.
+  static void update4(Hasher (&hashers)[4],
+                      std::uint8_t const* const (&data)[4], std::size_t size);
+
+  std::uint64_t digest() const;
+
+ private:
+  std::uint64_t v_[4];
+  std::uint64_t total_;
+  std::uint8_t buffer_[32];
+  std::size_t buffered_;
+  std::uint64_t seed_;
+};
+
+// calls `f(i)` for each `i` in [0, n) on the worker threads of the library,
+// with at most `concurrency` calls in flight (0 means the share of the
+// concurrency budget of the calling thread).
+// the calling thread takes part in the loop, so nested calls never deadlock.
+void parallel_for(int n, int concurrency, std::function<void(int)> const& f);
+
+// limits threads running loops of parallel_for() at once, callers included
+// (0 means the hardware concurrency). the budget is divided among host
+// threads in do_compute, as the host renders several tiles at once.
+void set_concurrency_budget(int threads);
+
+// the executor shared by all nodes of the plugin
+struct ExecutorStats {
+  int threads;           // worker threads besides callers
+  int budget;            // cf. set_concurrency_budget()
+  int computes;          // host threads in do_compute now
+  std::uint64_t tasks;   // tasks run by the workers
+  std::uint64_t steals;  // tasks taken from queues of other workers
+};
+
+ExecutorStats executor_stats();
+
+// the SIMD variant of the row kernels of the library ("portable", "sse2",
+// "avx2" or "avx512"), chosen for the CPU at plugin init. the environment
+// variable TNZU_SIMD selects another supported one.
+char const* simd_variant();
+
+template <std::size_t BitDepth, typename T>
+void linear_color_space_converter<BitDepth, T>::to_linear(cv::Mat const& src,
+                                                          cv::Mat& dst) const {
+  using value_type =
+      typename std::conditional<(BitDepth <= 8), std::uint8_t,
+                                std::uint16_t>::type;
+
+  int const cn = src.channels();
+  CV_Assert(src.depth() == cv::DataType<value_type>::depth);
+  dst.create(src.size(), CV_MAKETYPE(cv::DataType<T>::depth, cn));
+
+  T const* const forward = tables_->forward.get();
+  T const scale = T(1) / (Size - 1);
+  int const width = src.cols * cn;
+  int const rows = std::max(1, (1 << 16) / std::max(1, width));
+
+  tnzu::parallel_for((src.rows + rows - 1) / rows, 0, [&](int k) {
+    for (int y = k * rows, end = std::min(src.rows, y + rows); y < end; ++y) {
+      value_type const* s = src.ptr<value_type>(y);
+      T* d = dst.ptr<T>(y);
+      for (int x = 0; x < width; ++x) {
+        d[x] = forward[std::min<std::size_t>(s[x], Size - 1)];
+      }
+      if (cn == 4) {
+        for (int x = 3; x < width; x += 4) {
+          d[x] = s[x] * scale;
+        }
+      }
+    }
+  });
+}
+
+template <std::size_t BitDepth, typename T>
+void linear_color_space_converter<BitDepth, T>::to_nonlinear(
+    cv::Mat const& src, cv::Mat& dst) const {
+  using value_type =
+      typename std::conditional<(BitDepth <= 8), std::uint8_t,
+                                std::uint16_t>::type;
+
+  int const cn = src.channels();
+  CV_Assert(src.depth() == cv::DataType<T>::depth);
+  dst.create(src.size(), CV_MAKETYPE(cv::DataType<value_type>::depth, cn));
+
+  T const max = T(Size - 1);
+  int const width = src.cols * cn;
+  int const rows = std::max(1, (1 << 16) / std::max(1, width));
+
+  tnzu::parallel_for((src.rows + rows - 1) / rows, 0, [&](int k) {
+    for (int y = k * rows, end = std::min(src.rows, y + rows); y < end; ++y) {
+      T const* s = src.ptr<T>(y);
+      value_type* d = dst.ptr<value_type>(y);
+      for (int x = 0; x < width; ++x) {
+        d[x] = static_cast<value_type>(quantize(s[x]));
+      }
+      if (cn == 4) {
+        for (int x = 3; x < width; x += 4) {
+          d[x] = cv::saturate_cast<value_type>(s[x] * max);
+        }
+      }
+    }
+  });
+}
+
+// bytes transferred between host tiles and cv::Mat since the plugin was loaded
+struct TransferStats {
+  std::uint64_t copied_bytes;   // copied row by row
+  std::uint64_t aliased_bytes;  // wrapped as a cv::Mat header without copying
+};
+
+TransferStats transfer_stats();
+void reset_transfer_stats();
+
+// lookups of results cached by Fx::cache_budget() since the plugin was loaded
+struct CacheStats {
+  std::uint64_t hits;
+  std::uint64_t misses;
+};
+
+CacheStats cache_stats();
+void reset_cache_stats();
+
+// buffers of images, recycled between tiles and frames. the library allocates
+// its images from the pool, and so can effects by setting cv::Mat::allocator
+// to buffer_allocator() before create().
+cv::MatAllocator* buffer_allocator();
+
+// bytes of idle buffers kept by the pool, 1 GiB by default. idle buffers are
+// released when the last node ends rendering.
+void set_buffer_pool_limit(std::size_t bytes);
+
+// backs new buffers of 2 MiB or more by transparent huge pages (Linux only).
+// also enabled by the environment variable TNZU_HUGE_PAGES=1.
+void set_huge_pages(bool enable);
+
+struct BufferPoolStats {
+  std::size_t pooled_bytes;  // idle buffers
+  std::size_t live_bytes;    // buffers of images
+  std::uint64_t hits;        // allocations served by idle buffers
+  std::uint64_t misses;
+};
+
+BufferPoolStats buffer_pool_stats();
+
+// the run-time log level, one of TNZU_LOG_LEVEL_*. it starts from the macro
+// TNZU_LOG_LEVEL, or the variable TNZU_LOG_LEVEL of the environment if any.
+int log_level();
+void set_log_level(int level);
+void write_log(int level, std::string const& message);
+
+// a span from construction to destruction on the calling thread. `name` must
+// be a string literal. spans are kept in a ring buffer per thread without
+// locks, only while tracing is on.
+class TraceSpan {
+ public:
+  explicit TraceSpan(char const* name);
+  ~TraceSpan();
+
+ private:
+  TraceSpan(TraceSpan const&) = delete;
+  TraceSpan& operator=(TraceSpan const&) = delete;
+
+  char const* name_;
+  std::int64_t begin_;  // in nanoseconds, negative when not tracing
+};
+
+// records spans, and writes them to `path` as Chrome trace JSON (cf.
+// chrome://tracing) when the plugin exits. TNZU_TRACE in the environment
+// names the file to trace from the start.
+void start_trace(std::string const& path);
+void stop_trace();
+
+// writes spans recorded so far. threads should be idle, since the oldest
+// spans of a full ring are overwritten. the number of overwritten spans is
+// written as otherData.dropped_spans.
+bool write_trace(std::string const& path);
+
+// counter-based random numbers (Philox4x32-10). a block of four 32-bit
+// values is a pure function of a seed and a counter, so fields drawn by
+// coordinates are identical for any tiling and any order of evaluation.
+class Philox {
+ public:
+  using result_type = std::array<std::uint32_t, 4>;
+
+  explicit Philox(std::uint64_t seed)
+      : k0_(static_cast<std::uint32_t>(seed)),
+        k1_(static_cast<std::uint32_t>(seed >> 32)) {}
+
+  inline result_type operator()(std::uint32_t c0, std::uint32_t c1,
+                                std::uint32_t c2, std::uint32_t c3) const {
+    std::uint32_t k0 = k0_;
+    std::uint32_t k1 = k1_;
+    for (int i = 0; i < 10; ++i) {
+      std::uint64_t const p0 = std::uint64_t(0xD2511F53u) * c0;
+      std::uint64_t const p1 = std::uint64_t(0xCD9E8D57u) * c2;
+      c0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c1 = static_cast<std::uint32_t>(p1);
+      c2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c3 = static_cast<std::uint32_t>(p0);
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    result_type const r = {{c0, c1, c2, c3}};
+    return r;
+  }
+
+  // a value in [0, 1) of 24 random bits
+  static inline float to_unit(std::uint32_t r) {
+    return (r >> 8) * (1.0f / 16777216.0f);
+  }
+
+ private:
+  std::uint32_t k0_;
+  std::uint32_t k1_;
+};
+
+// fields of random numbers in `dst` of CV_8U, CV_16U or CV_32F of any
+// channels, whose (0, 0) is at `origin` of the canvas. each channel of a
+// pixel is drawn from (seed, x, y, frame, channel), so any region of the
+// canvas matches, and from a stream of the distribution, so fields of
+// different distributions are independent for a seed. values are normalized
+// to [0, 1] for integer depths.
+void fill_uniform(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                  int frame, double low = 0.0, double high = 1.0);
+
+// 1 with a probability `p`, otherwise 0
+void fill_bernoulli(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                    int frame, double p);
+
+void fill_normal(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                 int frame, double mean = 0.0, double stddev = 1.0);
+
+// a band of rows of for_each_band(), which owns scratch memory and a random
+// number generator while it is processed
+class Band {
+ public:
+  inline Band(int index, int begin, int end, std::uint64_t seed)
+      : index_(index), begin_(begin), end_(end), seed_(seed) {}
+
+  inline int index() const { return index_; }
+  inline int begin() const { return begin_; }
+  inline int end() const { return end_; }
+
+  // `n` elements of zero cleared memory in the slot `i`
+  template <typename T>
+  inline T* scratch(std::size_t n, std::size_t i = 0) {
+    if (scratch_.size() <= i) {
+      scratch_.resize(i + 1);
+    }
+    std::size_t const words =
+        (n * sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+    scratch_[i].assign(words, 0);
+    return reinterpret_cast<T*>(scratch_[i].data());
+  }
+
+  // a generator seeded by the seed of the loop and the index of the band
+  inline std::mt19937_64& rng() {
+    if (!rng_) {
+      Philox::result_type const r =
+          Philox(seed_)(static_cast<std::uint32_t>(index_), 0, 0, 0);
+      rng_.reset(new std::mt19937_64((std::uint64_t(r[0]) << 32) | r[1]));
+    }
+    return *rng_;
+  }
+
+ private:
+  int const index_;
+  int const begin_;
+  int const end_;
+  std::uint64_t const seed_;
+  std::vector<std::vector<std::uint64_t>> scratch_;
+  std::unique_ptr<std::mt19937_64> rng_;
+};
+
+// calls `f(band)` for bands of rows of an image of `size` in parallel.
+// images as small as a band, such as swatches, stay on the calling thread.
+void for_each_band(cv::Size size, std::uint64_t seed,
+                   std::function<void(Band&)> const& f);
+
+// calls `f(row, y, band)` for each row `y` of `img` of CV_8UC4 or CV_16UC4,
+// where `row` points to cv::Vec4b or cv::Vec4w pixels. returns false for
+// other types.
+template <typename F>
+bool for_each_row(cv::Mat& img, F f, std::uint64_t seed = 0) {
+  if (img.type() == CV_8UC4) {
+    tnzu::for_each_band(img.size(), seed, [&](Band& band) {
+      for (int y = band.begin(); y < band.end(); ++y) {
+        f(img.ptr<cv::Vec4b>(y), y, band);
+      }
+    });
+  } else if (img.type() == CV_16UC4) {
+    tnzu::for_each_band(img.size(), seed, [&](Band& band) {
+      for (int y = band.begin(); y < band.end(); ++y) {
+        f(img.ptr<cv::Vec4w>(y), y, band);
+      }
+    });
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <typename F>
+struct PixelRow {
+  template <typename Vec4T>
+  inline void operator()(Vec4T* row, int y, Band& band) const {
+    for (int x = 0; x < cols; ++x) {
+      f(row[x], x, y, band);
+    }
+  }
+
+  F& f;
+  int const cols;
+};
+
+// calls `f(pixel, x, y, band)` for each pixel of `img` as for_each_row()
+template <typename F>
+bool for_each_pixel(cv::Mat& img, F f, std::uint64_t seed = 0) {
+  PixelRow<F> const row = {f, img.cols};
+  return tnzu::for_each_row(img, row, seed);
+}
+
 // snp (salt and pepper) noise
 template <typename VecT>
 cv::Mat make_snp_noise(cv::Size const size, float const low, float const high) {
@@ -437,27 +1186,86 @@ cv::Mat make_snp_noise(cv::Size const size, float const low, float const high) {
   return retval;
 }
 
-// Perlin noise
+// Perlin gradient noise of a seed, evaluated at any point. gradients are
+// hashed from lattice coordinates, so regions of the same noise match.
+class GradientNoise {
+ public:
+  explicit GradientNoise(std::uint64_t seed);
+
+  // noise in about [-1, 1] at a point in units of lattice cells
+  float operator()(float x, float y) const;
+  float operator()(float x, float y, float t) const;
+
+  // fills `dst` of CV_32FC(channels) with the sum of `octaves` octaves in
+  // `roi` of a canvas of `size`. the octave i has 2 << i cells across the
+  // longer side and the amplitude amp[i]. channels are independent.
+  void render(cv::Mat& dst, int channels, cv::Size size, cv::Rect roi,
+              float const* amp, int octaves) const;
+
+  // as above, varying with `time`, which moves the octave 0 by a cell per
+  // unit
+  void render(cv::Mat& dst, int channels, cv::Size size, cv::Rect roi,
+              float const* amp, int octaves, double time) const;
+
+ private:
+  void render(cv::Mat& dst, int channels, cv::Size size, cv::Rect roi,
+              float const* amp, int octaves, bool animated,
+              double time) const;
+
+  std::uint32_t seed_;
+};
+
+// Perlin noise of `roi` (whole if empty) of a canvas of `size`
+template <typename VecT, std::size_t Sz>
+cv::Mat make_perlin_noise(cv::Size const size,
+                          std::array<float, Sz> const& amp,
+                          std::uint64_t const seed,
+                          cv::Rect const roi = cv::Rect()) {
+  int const type = tnzu::opencv_type_traits<VecT>::value;
+  cv::Rect const area = (roi.area() > 0) ? roi : cv::Rect(cv::Point(), size);
+
+  cv::Mat retval;
+  GradientNoise(seed).render(retval, CV_MAT_CN(type), size, area, amp.data(),
+                             static_cast<int>(Sz));
+  if (retval.type() != type) {
+    retval.convertTo(retval, type);
+  }
+  return retval;
+}
+
+// Perlin noise seeded by cv::theRNG()
 template <typename VecT, std::size_t Sz>
 cv::Mat make_perlin_noise(cv::Size const size,
                           std::array<float, Sz> const& amp) {
-  cv::Mat retval = cv::Mat::zeros(size, tnzu::opencv_type_traits<VecT>::value);
+  cv::RNG& rng = cv::theRNG();
+  std::uint64_t const seed = (std::uint64_t(rng.next()) << 32) | rng.next();
+  return tnzu::make_perlin_noise<VecT, Sz>(size, amp, seed);
+}
 
-  int num = 0;
-  for (std::size_t i = 0; i < Sz; ++i) {
-    float const range = amp[i];
-    cv::Size const octave_size(2 << i, 2 << i);
+// sum of blurred images of a pyramid, accumulated in float. buffers are kept
+// between calls; an instance must not be used by threads at once.
+class Bloom {
+ public:
+  // writes the part in `roi` (whole if empty) of the bloom of `src` of up to
+  // `level` levels to `dst` of the type of `src`. colors darker than
+  // `threshold` are excluded, fading in over `knee`.
+  void apply(cv::Mat const& src, cv::Mat& dst, int level, int radius,
+             float threshold = 0.0f, float knee = 0.0f,
+             cv::Rect roi = cv::Rect());
 
-    cv::Mat field = tnzu::make_snp_noise<VecT>(octave_size, -range, range);
+  // region of a source required for `roi` of the result, aligned to pixels
+  // of the coarsest level. tiles of sources aligned so join seamlessly.
+  static cv::Rect require(cv::Rect const& roi, int level, int radius);
 
-    float const scale = std::max(float(size.width) / octave_size.width,
-                                 float(size.height) / octave_size.height);
-    cv::resize(field, field, size, scale, scale, cv::INTER_CUBIC);
-    retval += field;
-  }
+  // frees the buffers
+  void release();
 
-  return retval;
-}
+ private:
+  std::vector<cv::Size> sizes_;
+  std::vector<cv::Mat> levels_;
+  std::vector<cv::Mat> blurred_;
+  cv::Mat upsampled_;
+};
 
 void generate_bloom(cv::Mat& img, int level, int radius = 1);
 
@@ -468,16 +1276,55 @@ cv::Rect_<T> make_infinite_rect() {
       +std::numeric_limits<T>::infinity(), +std::numeric_limits<T>::infinity());
 }
 
+// composites premultiplied `img` over `canvas` at floor(`pos`).
+// the result is exact: d * (max - a) / max + s in integers.
 void draw_image(cv::Mat& canvas, cv::Mat const& img, cv::Point2d pos);
 
+// how sample_image() reads outside of a source
+enum SampleBorder {
+  SAMPLE_BORDER_WRAP,         // tiles the source
+  SAMPLE_BORDER_CLAMP,        // repeats edge pixels
+  SAMPLE_BORDER_TRANSPARENT,  // zero outside
+};
+
+enum SampleFilter {
+  SAMPLE_FILTER_BILINEAR,
+  // INTER_CUBIC of OpenCV. overshoots are clamped to premultiplied values.
+  SAMPLE_FILTER_BICUBIC,
+};
+
+// samples premultiplied `src` of CV_8UC4 or CV_16UC4 at source coordinates
+// `coords` of CV_32FC2, into `dst` of the size of `coords` and the type of
+// `src`. integer coordinates are centers of pixels, as tap_texel().
+// rows are sampled in parallel.
+void sample_image(cv::Mat const& src, cv::Mat const& coords, cv::Mat& dst,
+                  SampleBorder border = SAMPLE_BORDER_WRAP,
+                  SampleFilter filter = SAMPLE_FILTER_BILINEAR);
+
+// as above, at m * (x, y) for each pixel (x, y) of `dst` of `size`
+void sample_image(cv::Mat const& src, cv::Matx23d const& m, cv::Size size,
+                  cv::Mat& dst, SampleBorder border = SAMPLE_BORDER_WRAP,
+                  SampleFilter filter = SAMPLE_FILTER_BILINEAR);
+
+// as above, at `size.width` points that `row(y, coords)` fills for each row
+// `y` of `dst` of `size`. `row` is called by worker threads at once.
+void sample_image(cv::Mat const& src, cv::Size size,
+                  std::function<void(int, cv::Point2f*)> const& row,
+                  cv::Mat& dst, SampleBorder border = SAMPLE_BORDER_WRAP,
+                  SampleFilter filter = SAMPLE_FILTER_BILINEAR);
+
+// a bilinear sample of `src` at `pos`, wrapped around. prefer sample_image()
+// for many points.
 template <typename Vec4T>
 Vec4T tap_texel(cv::Mat const& src, cv::Point2d const& pos) {
-  int const x0 = static_cast<int>(std::floor(pos.x));
-  int const y0 = static_cast<int>(std::floor(pos.y));
-  int const x1 = cv::borderInterpolate(x0 + 1, src.cols, cv::BORDER_WRAP);
-  int const y1 = cv::borderInterpolate(y0 + 1, src.rows, cv::BORDER_WRAP);
-  float const sx = pos.x - x0;
-  float const sy = pos.y - y0;
+  int const fx = static_cast<int>(std::floor(pos.x));
+  int const fy = static_cast<int>(std::floor(pos.y));
+  int const x0 = cv::borderInterpolate(fx + 0, src.cols, cv::BORDER_WRAP);
+  int const y0 = cv::borderInterpolate(fy + 0, src.rows, cv::BORDER_WRAP);
+  int const x1 = cv::borderInterpolate(fx + 1, src.cols, cv::BORDER_WRAP);
+  int const y1 = cv::borderInterpolate(fy + 1, src.rows, cv::BORDER_WRAP);
+  float const sx = pos.x - fx;
+  float const sy = pos.y - fy;
 
   Vec4T const s00 = src.at<Vec4T>(y0, x0);
   Vec4T const s01 = src.at<Vec4T>(y0, x1);
@@ -55,6 +55,12 @@ class MyFx : public tnzu::Fx {
   }
 
  public:
+  int require(Config const& config, Params const& params,
+              cv::Rect2d& retrc) override {
+    // each pixel depends on the same pixel of the input
+    return 0;
+  }
+
   int compute(Config const& config, Params const& params, Args const& args,
               cv::Mat& retimg) override try {
     DEBUG_PRINT(__FUNCTION__);
@@ -69,7 +75,7 @@ class MyFx : public tnzu::Fx {
 
     return 0;
   } catch (cv::Exception const& e) {
-    DEBUG_PRINT(e.what());
+    TNZU_LOG_ERROR(e.what());
   }
 };
 
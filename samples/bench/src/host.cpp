@@ -0,0 +1,472 @@
+#include "host.hpp"
+
+#include <cstring>
+
+#include <dlfcn.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace {
+bench::Node* to_node(toonz_node_handle_t node) {
+  return static_cast<bench::Node*>(node);
+}
+
+//
+// node
+//
+int node_get_input_port(toonz_node_handle_t node, const char* name,
+                        toonz_port_handle_t* port) {
+  if (!node || !name || !port) {
+    return TOONZ_ERROR_NULL;
+  }
+  *port = to_node(node)->port(name);
+  return *port ? TOONZ_OK : TOONZ_ERROR_NOT_FOUND;
+}
+
+int node_get_param(toonz_node_handle_t node, const char* name,
+                   toonz_param_handle_t* param) {
+  if (!node || !name || !param) {
+    return TOONZ_ERROR_NULL;
+  }
+  *param = to_node(node)->param(name);
+  return *param ? TOONZ_OK : TOONZ_ERROR_NOT_FOUND;
+}
+
+int node_set_user_data(toonz_node_handle_t node, void* data) {
+  if (!node) {
+    return TOONZ_ERROR_NULL;
+  }
+  to_node(node)->user_data = data;
+  return TOONZ_OK;
+}
+
+int node_get_user_data(toonz_node_handle_t node, void** data) {
+  if (!node || !data) {
+    return TOONZ_ERROR_NULL;
+  }
+  *data = to_node(node)->user_data;
+  return TOONZ_OK;
+}
+
+//
+// port
+//
+int port_is_connected(toonz_port_handle_t port, int* connected) {
+  if (!port || !connected) {
+    return TOONZ_ERROR_NULL;
+  }
+  *connected = (static_cast<bench::Port*>(port)->source != nullptr);
+  return TOONZ_OK;
+}
+
+int port_get_fx(toonz_port_handle_t port, toonz_fxnode_handle_t* fxnode) {
+  if (!port || !fxnode) {
+    return TOONZ_ERROR_NULL;
+  }
+  *fxnode = const_cast<bench::Source*>(static_cast<bench::Port*>(port)->source);
+  return TOONZ_OK;
+}
+
+//
+// fxnode
+//
+int fxnode_get_bbox(toonz_fxnode_handle_t fxnode,
+                    const toonz_rendering_setting_t* rs, double frame,
+                    toonz_rect_t* rect, int* got) {
+  if (!fxnode || !rect || !got) {
+    return TOONZ_ERROR_NULL;
+  }
+  *rect = static_cast<bench::Source const*>(fxnode)->bbox();
+  *got = 1;
+  return TOONZ_OK;
+}
+
+int fxnode_compute_to_tile(toonz_fxnode_handle_t fxnode,
+                           const toonz_rendering_setting_t* rs, double frame,
+                           const toonz_rect_t* rect, toonz_tile_handle_t src,
+                           toonz_tile_handle_t dst) {
+  if (!fxnode || !rs || !rect || !dst) {
+    return TOONZ_ERROR_NULL;
+  }
+
+  bench::Tile* tile = bench::to_tile(dst);
+  tile->rect = *rect;
+  tile->elem_type = (rs->bpp == 64) ? TOONZ_TILE_TYPE_64P : TOONZ_TILE_TYPE_32P;
+  tile->pixels.create(static_cast<int>(rect->y1 - rect->y0),
+                      static_cast<int>(rect->x1 - rect->x0),
+                      (rs->bpp == 64) ? CV_16UC4 : CV_8UC4);
+  static_cast<bench::Source const*>(fxnode)->render(*rect, tile->pixels);
+  return TOONZ_OK;
+}
+
+//
+// param
+//
+int param_get_value(toonz_param_handle_t param, double frame, int* size,
+                    void* value) {
+  if (!param || !size) {
+    return TOONZ_ERROR_NULL;
+  }
+  if (value) {
+    *static_cast<double*>(value) = static_cast<bench::Param*>(param)->value;
+  }
+  *size = 1;
+  return TOONZ_OK;
+}
+
+//
+// tile
+//
+int tile_get_raw_address_unsafe(toonz_tile_handle_t tile, void** address) {
+  if (!tile || !address) {
+    return TOONZ_ERROR_NULL;
+  }
+  *address = bench::to_tile(tile)->pixels.data;
+  return TOONZ_OK;
+}
+
+int tile_get_raw_stride(toonz_tile_handle_t tile, int* stride) {
+  if (!tile || !stride) {
+    return TOONZ_ERROR_NULL;
+  }
+  *stride = static_cast<int>(bench::to_tile(tile)->pixels.step);
+  return TOONZ_OK;
+}
+
+int tile_get_element_type(toonz_tile_handle_t tile, int* elem_type) {
+  if (!tile || !elem_type) {
+    return TOONZ_ERROR_NULL;
+  }
+  *elem_type = bench::to_tile(tile)->elem_type;
+  return TOONZ_OK;
+}
+
+int tile_create(toonz_tile_handle_t* tile) {
+  if (!tile) {
+    return TOONZ_ERROR_NULL;
+  }
+  toonz_rect_t empty;
+  empty.x0 = empty.y0 = empty.x1 = empty.y1 = 0;
+  *tile = bench::create_tile(empty, TOONZ_TILE_TYPE_NONE);
+  return TOONZ_OK;
+}
+
+int tile_destroy(toonz_tile_handle_t tile) {
+  bench::destroy_tile(tile);
+  return TOONZ_OK;
+}
+
+int tile_get_rectangle(toonz_tile_handle_t tile, toonz_rect_t* rect) {
+  if (!tile || !rect) {
+    return TOONZ_ERROR_NULL;
+  }
+  *rect = bench::to_tile(tile)->rect;
+  return TOONZ_OK;
+}
+
+int tile_safen(toonz_tile_handle_t tile) {
+  return tile ? TOONZ_OK : TOONZ_ERROR_NULL;
+}
+
+//
+// setup
+//
+int setup_set_parameter_pages_with_error(toonz_node_handle_t node, int num,
+                                         toonz_param_page_t* pages,
+                                         int* errcode, void** entry) {
+  if (!node || (num && !pages)) {
+    return TOONZ_ERROR_NULL;
+  }
+
+  // the default values are the values of the parameters
+  for (int i = 0; i < num; i++) {
+    for (int j = 0; j < pages[i].num; j++) {
+      toonz_param_group_t const& group = pages[i].array[j];
+      for (int k = 0; k < group.num; k++) {
+        toonz_param_desc_t const& desc = group.array[k];
+        if (desc.traits_tag != TOONZ_PARAM_TYPE_DOUBLE) {
+          if (errcode) {
+            *errcode = TOONZ_ERROR_NOT_IMPLEMENTED;
+          }
+          if (entry) {
+            *entry = const_cast<toonz_param_desc_t*>(&desc);
+          }
+          return TOONZ_ERROR_NOT_IMPLEMENTED;
+        }
+        to_node(node)->params.emplace_back(
+            new bench::Param{desc.key, desc.traits.d.def});
+      }
+    }
+  }
+  return TOONZ_OK;
+}
+
+int setup_add_input_port(toonz_node_handle_t node, const char* name,
+                         int type) {
+  if (!node || !name) {
+    return TOONZ_ERROR_NULL;
+  }
+  if (type != TOONZ_PORT_TYPE_RASTER) {
+    return TOONZ_ERROR_NOT_IMPLEMENTED;
+  }
+  to_node(node)->ports.emplace_back(new bench::Port{name, nullptr});
+  return TOONZ_OK;
+}
+
+//
+// host
+//
+toonz_node_interface_t make_node_interface() {
+  toonz_node_interface_t nodeif;
+  std::memset(&nodeif, 0, sizeof(nodeif));
+  nodeif.ver.major = 1;
+  nodeif.get_input_port = node_get_input_port;
+  nodeif.get_param = node_get_param;
+  nodeif.set_user_data = node_set_user_data;
+  nodeif.get_user_data = node_get_user_data;
+  return nodeif;
+}
+
+toonz_port_interface_t make_port_interface() {
+  toonz_port_interface_t portif;
+  std::memset(&portif, 0, sizeof(portif));
+  portif.ver.major = 1;
+  portif.is_connected = port_is_connected;
+  portif.get_fx = port_get_fx;
+  return portif;
+}
+
+toonz_fxnode_interface_t make_fxnode_interface() {
+  toonz_fxnode_interface_t fxif;
+  std::memset(&fxif, 0, sizeof(fxif));
+  fxif.ver.major = 1;
+  fxif.get_bbox = fxnode_get_bbox;
+  fxif.compute_to_tile = fxnode_compute_to_tile;
+  return fxif;
+}
+
+toonz_param_interface_t make_param_interface() {
+  toonz_param_interface_t paramif;
+  std::memset(&paramif, 0, sizeof(paramif));
+  paramif.ver.major = 1;
+  paramif.get_value = param_get_value;
+  return paramif;
+}
+
+toonz_tile_interface_t make_tile_interface() {
+  toonz_tile_interface_t tileif;
+  std::memset(&tileif, 0, sizeof(tileif));
+  tileif.ver.major = 1;
+  tileif.get_raw_address_unsafe = tile_get_raw_address_unsafe;
+  tileif.get_raw_stride = tile_get_raw_stride;
+  tileif.get_element_type = tile_get_element_type;
+  tileif.create = tile_create;
+  tileif.destroy = tile_destroy;
+  tileif.get_rectangle = tile_get_rectangle;
+  tileif.safen = tile_safen;
+  return tileif;
+}
+
+toonz_setup_interface_t make_setup_interface() {
+  toonz_setup_interface_t setupif;
+  std::memset(&setupif, 0, sizeof(setupif));
+  setupif.ver.major = 1;
+  setupif.set_parameter_pages_with_error =
+      setup_set_parameter_pages_with_error;
+  setupif.add_input_port = setup_add_input_port;
+  return setupif;
+}
+
+bool equals(const toonz_UUID* a, const toonz_UUID* b) {
+  return (a->uid0 == b->uid0) && (a->uid1 == b->uid1) &&
+         (a->uid2 == b->uid2) && (a->uid3 == b->uid3) && (a->uid4 == b->uid4);
+}
+
+int query_interface(const toonz_UUID* uuid, void** interf) {
+  static toonz_node_interface_t nodeif = make_node_interface();
+  static toonz_port_interface_t portif = make_port_interface();
+  static toonz_fxnode_interface_t fxif = make_fxnode_interface();
+  static toonz_param_interface_t paramif = make_param_interface();
+  static toonz_tile_interface_t tileif = make_tile_interface();
+  static toonz_setup_interface_t setupif = make_setup_interface();
+
+  if (!uuid || !interf) {
+    return TOONZ_ERROR_NULL;
+  }
+
+  if (equals(uuid, TOONZ_UUID_NODE)) {
+    *interf = &nodeif;
+  } else if (equals(uuid, TOONZ_UUID_PORT)) {
+    *interf = &portif;
+  } else if (equals(uuid, TOONZ_UUID_FXNODE)) {
+    *interf = &fxif;
+  } else if (equals(uuid, TOONZ_UUID_PARAM)) {
+    *interf = &paramif;
+  } else if (equals(uuid, TOONZ_UUID_TILE)) {
+    *interf = &tileif;
+  } else if (equals(uuid, TOONZ_UUID_SETUP)) {
+    *interf = &setupif;
+  } else {
+    *interf = nullptr;
+    return TOONZ_ERROR_NOT_IMPLEMENTED;
+  }
+  return TOONZ_OK;
+}
+
+// interfaces are static
+void release_interface(void* interf) {}
+}
+
+namespace bench {
+Source::Source(cv::Mat const& image) {
+  cv::Mat bgra;
+  if (image.channels() == 1) {
+    cv::cvtColor(image, bgra, cv::COLOR_GRAY2BGRA);
+  } else if (image.channels() == 3) {
+    cv::cvtColor(image, bgra, cv::COLOR_BGR2BGRA);
+  } else {
+    bgra = image;
+  }
+
+  bgra.convertTo(image16_, CV_16U, (bgra.depth() == CV_8U) ? 257.0 : 1.0);
+
+  // tiles of the host are premultiplied
+  for (int y = 0; y < image16_.rows; y++) {
+    cv::Vec4w* p = image16_.ptr<cv::Vec4w>(y);
+    for (int x = 0; x < image16_.cols; x++) {
+      std::uint32_t const a = p[x][3];
+      for (int c = 0; c < 3; c++) {
+        p[x][c] = static_cast<std::uint16_t>((p[x][c] * a + 32767) / 65535);
+      }
+    }
+  }
+
+  image16_.convertTo(image8_, CV_8U, 1.0 / 257.0);
+}
+
+cv::Mat Source::synthetic(cv::Size size, std::uint64_t seed) {
+  cv::Mat image(size, CV_16UC4);
+  cv::RNG rng(seed);
+
+  cv::Point2d const center(size.width * 0.5, size.height * 0.5);
+  double const radius = std::min(size.width, size.height) * 0.25;
+  for (int y = 0; y < size.height; y++) {
+    cv::Vec4w* p = image.ptr<cv::Vec4w>(y);
+    for (int x = 0; x < size.width; x++) {
+      int const noise = rng.uniform(-2048, 2048);
+      double const dx = x - center.x;
+      double const dy = y - center.y;
+      p[x] = cv::Vec4w(
+          cv::saturate_cast<std::uint16_t>(x * 65535 / size.width + noise),
+          cv::saturate_cast<std::uint16_t>(y * 65535 / size.height + noise),
+          cv::saturate_cast<std::uint16_t>(((x ^ y) & 255) * 257 + noise),
+          (dx * dx + dy * dy < radius * radius) ? 32768 : 65535);
+    }
+  }
+  return image;
+}
+
+toonz_rect_t Source::bbox() const {
+  toonz_rect_t rect;
+  rect.x0 = 0;
+  rect.y0 = 0;
+  rect.x1 = image16_.cols;
+  rect.y1 = image16_.rows;
+  return rect;
+}
+
+void Source::render(toonz_rect_t const& rect, cv::Mat& dst) const {
+  cv::Mat const& image = (dst.depth() == CV_16U) ? image16_ : image8_;
+
+  cv::Rect const area(static_cast<int>(rect.x0), static_cast<int>(rect.y0),
+                      dst.cols, dst.rows);
+  cv::Rect const overlap = area & cv::Rect(0, 0, image.cols, image.rows);
+
+  dst = cv::Scalar::all(0);
+  if (overlap.area() > 0) {
+    image(overlap).copyTo(dst(overlap - area.tl()));
+  }
+}
+
+Param* Node::param(char const* name) {
+  for (std::unique_ptr<Param> const& param : params) {
+    if (param->name == name) {
+      return param.get();
+    }
+  }
+  return nullptr;
+}
+
+Port* Node::port(char const* name) {
+  for (std::unique_ptr<Port> const& port : ports) {
+    if (port->name == name) {
+      return port.get();
+    }
+  }
+  return nullptr;
+}
+
+Plugin::Plugin(std::string const& path)
+    : dl_(nullptr), init_(nullptr), exit_(nullptr), handler_(nullptr) {
+  dl_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!dl_) {
+    error_ = dlerror();
+    return;
+  }
+
+  init_ = reinterpret_cast<int (*)(toonz_host_interface_t*)>(
+      dlsym(dl_, "toonz_plugin_init"));
+  exit_ = reinterpret_cast<void (*)()>(dlsym(dl_, "toonz_plugin_exit"));
+  toonz_nodal_rasterfx_handler_t_* const handler =
+      static_cast<toonz_nodal_rasterfx_handler_t_*>(
+          dlsym(dl_, "toonz_plugin_node_handler"));
+  if (!init_ || !exit_ || !handler) {
+    error_ = path + " is not a plugin of opentoonz_plugin_utility";
+    return;
+  }
+  handler_ = handler;
+}
+
+Plugin::~Plugin() {
+  if (dl_) {
+    dlclose(dl_);
+  }
+}
+
+int Plugin::init() {
+  return init_ ? init_(host_interface()) : TOONZ_ERROR_PREREQUISITE;
+}
+
+void Plugin::exit() {
+  if (exit_) {
+    exit_();
+  }
+}
+
+toonz_host_interface_t* host_interface() {
+  static toonz_host_interface_t hostif = [] {
+    toonz_host_interface_t hostif;
+    std::memset(&hostif, 0, sizeof(hostif));
+    hostif.ver.major = 1;
+    hostif.query_interface = query_interface;
+    hostif.release_interface = release_interface;
+    return hostif;
+  }();
+  return &hostif;
+}
+
+toonz_tile_handle_t create_tile(toonz_rect_t const& rect, int elem_type) {
+  Tile* tile = new Tile();
+  tile->rect = rect;
+  tile->elem_type = elem_type;
+  if (elem_type != TOONZ_TILE_TYPE_NONE) {
+    tile->pixels =
+        cv::Mat::zeros(static_cast<int>(rect.y1 - rect.y0),
+                       static_cast<int>(rect.x1 - rect.x0),
+                       (elem_type == TOONZ_TILE_TYPE_64P) ? CV_16UC4 : CV_8UC4);
+  }
+  return tile;
+}
+
+void destroy_tile(toonz_tile_handle_t tile) { delete to_tile(tile); }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <toonz_plugin.h>
+#include <toonz_hostif.h>
+#include <toonz_params.h>
+
+// an in-process stand-in of the host, which renders plugin effects without
+// OpenToonz. handles given to plugins are pointers to the structures below.
+namespace bench {
+
+// an upstream node feeding input ports. its image lies at (0, 0) of the
+// output space, and is kept in both depths to render tiles of either.
+class Source {
+ public:
+  // `image` of 1, 3 or 4 channels of 8 or 16 bits, whose alpha is straight
+  explicit Source(cv::Mat const& image);
+
+  // gradients and noise with a translucent disc, in 16 bits
+  static cv::Mat synthetic(cv::Size size, std::uint64_t seed);
+
+  toonz_rect_t bbox() const;
+
+  // copies `rect` of the image to `dst`, which is zero outside the image
+  void render(toonz_rect_t const& rect, cv::Mat& dst) const;
+
+ private:
+  cv::Mat image8_;
+  cv::Mat image16_;
+};
+
+struct Tile {
+  toonz_rect_t rect;
+  int elem_type;
+  cv::Mat pixels;  // CV_8UC4 or CV_16UC4, empty until allocated
+};
+
+struct Param {
+  std::string name;
+  double value;
+};
+
+struct Port {
+  std::string name;
+  Source const* source;  // null if disconnected
+};
+
+// an instance of the effect
+struct Node {
+  Node() : user_data(nullptr) {}
+
+  Param* param(char const* name);
+  Port* port(char const* name);
+
+  std::vector<std::unique_ptr<Param>> params;
+  std::vector<std::unique_ptr<Port>> ports;
+  void* user_data;
+};
+
+// a plugin loaded by dlopen(). the library defines the entry points and the
+// handler of the effect with TNZU_DEFINE_INTERFACE.
+class Plugin {
+ public:
+  explicit Plugin(std::string const& path);
+  ~Plugin();
+
+  Plugin(Plugin const&) = delete;
+  Plugin& operator=(Plugin const&) = delete;
+
+  bool loaded() const { return handler_ != nullptr; }
+  std::string const& error() const { return error_; }
+
+  toonz_nodal_rasterfx_handler_t_* handler() const { return handler_; }
+
+  int init();
+  void exit();
+
+ private:
+  void* dl_;
+  int (*init_)(toonz_host_interface_t*);
+  void (*exit_)();
+  toonz_nodal_rasterfx_handler_t_* handler_;
+  std::string error_;
+};
+
+// interfaces queried by plugins
+toonz_host_interface_t* host_interface();
+
+// a tile of `rect` allocated by the host, cf. the destroy of the interface
+toonz_tile_handle_t create_tile(toonz_rect_t const& rect, int elem_type);
+void destroy_tile(toonz_tile_handle_t tile);
+
+inline Tile* to_tile(toonz_tile_handle_t tile) {
+  return static_cast<Tile*>(tile);
+}
+}
@@ -0,0 +1,406 @@
+// renders sample effects with the stand-in host, and reports timings
+//
+//   tnzu_bench [-n frames] [-j threads] [-i image] plugin...
+//
+// the random number generator of the library is checked against known
+// answers first. each case runs in a child process, so that it starts with a
+// fresh plugin and the trace written by toonz_plugin_exit covers only that
+// case.
+#include "host.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <toonz_utility.hpp>
+
+namespace {
+// spans recorded by the library, cf. TNZU_TRACE_SPAN
+char const* const stage_names[] = {
+    "do_compute", "get_params", "compute_to_tile",
+    "to_mat",     "Fx::compute", "from_mat",
+};
+
+int const stage_count = sizeof(stage_names) / sizeof(stage_names[0]);
+
+struct Options {
+  Options() : frames(5), threads(1) {}
+
+  int frames;
+  int threads;  // host threads rendering tiles at once
+  std::string image;
+  std::vector<std::string> plugins;
+};
+
+struct Case {
+  cv::Size size;
+  int bpp;
+  int tile;  // width and height of tiles, 0 for a tile per frame
+};
+
+struct Result {
+  int ok;
+  double frame_ms;                // median of frames
+  double stage_ms[stage_count];  // per frame, summed over threads
+  unsigned long long dropped;    // spans lost by full trace rings
+};
+
+// adds durations of spans of the Chrome trace at `path` to `ms`, and counts
+// spans the library could not keep to `dropped`
+bool read_trace(std::string const& path, double* ms,
+                unsigned long long& dropped) {
+  std::FILE* fp = std::fopen(path.c_str(), "r");
+  if (!fp) {
+    return false;
+  }
+
+  char line[512];
+  while (std::fgets(line, sizeof(line), fp)) {
+    char name[256];
+    int tid = 0;
+    double ts = 0;
+    double dur = 0;
+    if (std::sscanf(line, "\"otherData\":{\"dropped_spans\":%llu}",
+                    &dropped) == 1) {
+      continue;
+    }
+    if (std::sscanf(line,
+                    "{\"name\":\"%255[^\"]\",\"ph\":\"X\",\"pid\":1,"
+                    "\"tid\":%d,\"ts\":%lf,\"dur\":%lf}",
+                    name, &tid, &ts, &dur) != 4) {
+      continue;
+    }
+    for (int i = 0; i < stage_count; i++) {
+      if (std::strcmp(name, stage_names[i]) == 0) {
+        ms[i] += dur * 1e-3;
+      }
+    }
+  }
+
+  std::fclose(fp);
+  return true;
+}
+
+toonz_rendering_setting_t make_setting(Case const& c) {
+  toonz_rendering_setting_t rs;
+  std::memset(&rs, 0, sizeof(rs));
+  rs.ver.major = 1;
+  rs.affine.a11 = 1;
+  rs.affine.a22 = 1;
+  rs.gamma = 1;
+  rs.time_stretch_from = 25;
+  rs.time_stretch_to = 25;
+  rs.bpp = c.bpp;
+  // in megabytes
+  int const tile = (c.tile > 0) ? c.tile : std::max(c.size.width,
+                                                    c.size.height);
+  rs.max_tile_size = (tile * tile * c.bpp / 8 + (1 << 20) - 1) >> 20;
+  rs.user_cachable = 1;
+  return rs;
+}
+
+std::vector<toonz_rect_t> split_frame(cv::Size size, int tile) {
+  int const tw = (tile > 0) ? tile : size.width;
+  int const th = (tile > 0) ? tile : size.height;
+
+  std::vector<toonz_rect_t> rects;
+  for (int y = 0; y < size.height; y += th) {
+    for (int x = 0; x < size.width; x += tw) {
+      toonz_rect_t rect;
+      rect.x0 = x;
+      rect.y0 = y;
+      rect.x1 = std::min(x + tw, size.width);
+      rect.y1 = std::min(y + th, size.height);
+      rects.push_back(rect);
+    }
+  }
+  return rects;
+}
+
+cv::Mat load_image(Options const& opts, cv::Size size) {
+  if (opts.image.empty()) {
+    return bench::Source::synthetic(size, 1);
+  }
+
+  cv::Mat image = cv::imread(opts.image, cv::IMREAD_UNCHANGED);
+  if (!image.empty() && (image.size() != size)) {
+    cv::resize(image, image, size, 0, 0, cv::INTER_AREA);
+  }
+  return image;
+}
+
+// renders frames of a case. called in a child process.
+Result run(Options const& opts, std::string const& path, Case const& c) {
+  Result result = {};
+
+  std::string const trace =
+      "/tmp/tnzu_bench_" + std::to_string(getpid()) + ".json";
+  setenv("TNZU_TRACE", trace.c_str(), 1);
+  setenv("TNZU_LOG_LEVEL", "1", 0);
+
+  bench::Plugin plugin(path);
+  if (!plugin.loaded()) {
+    std::fprintf(stderr, "%s\n", plugin.error().c_str());
+    return result;
+  }
+  if (plugin.init() != TOONZ_OK) {
+    std::fprintf(stderr, "%s: toonz_plugin_init failed\n", path.c_str());
+    return result;
+  }
+
+  cv::Mat const image = load_image(opts, c.size);
+  if (image.empty()) {
+    std::fprintf(stderr, "could not read %s\n", opts.image.c_str());
+    plugin.exit();
+    return result;
+  }
+  bench::Source const source(image);
+
+  toonz_nodal_rasterfx_handler_t_* const handler = plugin.handler();
+
+  bench::Node node;
+  handler->setup(&node);
+  for (std::unique_ptr<bench::Port> const& port : node.ports) {
+    port->source = &source;
+  }
+  handler->create(&node);
+
+  toonz_rendering_setting_t const rs = make_setting(c);
+  int const elem_type =
+      (c.bpp == 64) ? TOONZ_TILE_TYPE_64P : TOONZ_TILE_TYPE_32P;
+
+  std::vector<toonz_tile_handle_t> tiles;
+  for (toonz_rect_t const& rect : split_frame(c.size, c.tile)) {
+    tiles.push_back(bench::create_tile(rect, elem_type));
+  }
+
+  handler->start_render(&node);
+
+  std::vector<double> times;
+  for (int frame = 0; frame < opts.frames; frame++) {
+    handler->on_new_frame(&node, &rs, frame);
+
+    auto const begin = std::chrono::steady_clock::now();
+
+    // host threads take tiles in order, as the render queue of the host
+    std::atomic<int> next(0);
+    auto const render = [&] {
+      for (int i = next++; i < static_cast<int>(tiles.size()); i = next++) {
+        handler->do_compute(&node, &rs, frame, tiles[i]);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < opts.threads; i++) {
+      threads.emplace_back(render);
+    }
+    render();
+    for (std::thread& t : threads) {
+      t.join();
+    }
+
+    auto const end = std::chrono::steady_clock::now();
+    times.push_back(
+        std::chrono::duration<double, std::milli>(end - begin).count());
+
+    handler->on_end_frame(&node, &rs, frame);
+  }
+
+  handler->end_render(&node);
+  handler->destroy(&node);
+  for (toonz_tile_handle_t tile : tiles) {
+    bench::destroy_tile(tile);
+  }
+
+  // writes the trace
+  plugin.exit();
+
+  if (read_trace(trace, result.stage_ms, result.dropped)) {
+    for (double& ms : result.stage_ms) {
+      ms /= opts.frames;
+    }
+  }
+  std::remove(trace.c_str());
+
+  std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                   times.end());
+  result.frame_ms = times[times.size() / 2];
+  result.ok = 1;
+  return result;
+}
+
+// runs a case in a child process
+Result fork_run(Options const& opts, std::string const& path, Case const& c) {
+  Result result = {};
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return result;
+  }
+
+  pid_t const pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    Result const r = run(opts, path, c);
+    ssize_t const written = write(fds[1], &r, sizeof(r));
+    _exit((written == sizeof(r)) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  if (pid > 0) {
+    if (read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+      result.ok = 0;
+    }
+    waitpid(pid, nullptr, 0);
+  }
+  close(fds[0]);
+  return result;
+}
+
+void print_header() {
+  std::printf("%-32s %-9s %3s %5s %9s %8s", "plugin", "size", "bpp", "tile",
+              "frame ms", "MP/s");
+  for (int i = 0; i < stage_count; i++) {
+    std::printf(" %15s", stage_names[i]);
+  }
+  std::printf("\n");
+}
+
+void print_result(std::string const& path, Case const& c, Result const& r) {
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  std::string const size =
+      std::to_string(c.size.width) + "x" + std::to_string(c.size.height);
+  std::string const tile = (c.tile > 0) ? std::to_string(c.tile) : "frame";
+
+  std::printf("%-32s %-9s %3d %5s", name.c_str(), size.c_str(), c.bpp,
+              tile.c_str());
+  if (!r.ok) {
+    std::printf(" %9s\n", "failed");
+    return;
+  }
+
+  double const mpixels = c.size.area() * 1e-6;
+  std::printf(" %9.2f %8.1f", r.frame_ms, mpixels / (r.frame_ms * 1e-3));
+  for (int i = 0; i < stage_count; i++) {
+    // partial sums would read as too fast
+    if (r.dropped) {
+      std::printf(" %15s", "-");
+    } else {
+      std::printf(" %15.2f", r.stage_ms[i]);
+    }
+  }
+  std::printf("\n");
+  if (r.dropped) {
+    std::fprintf(stderr,
+                 "%s: %llu trace spans were dropped, stage times are not "
+                 "shown. run fewer frames (-n).\n",
+                 name.c_str(), r.dropped);
+  }
+  std::fflush(stdout);
+}
+
+// known answers of Philox4x32-10 from Random123 (kat_vectors), which random
+// fields of the library are drawn from
+bool check_philox() {
+  struct Vector {
+    std::uint32_t counter[4];
+    std::uint64_t key;
+    std::uint32_t result[4];
+  };
+  static Vector const vectors[] = {
+      {{0x00000000, 0x00000000, 0x00000000, 0x00000000},
+       0x0000000000000000,
+       {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+      {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+       0xffffffffffffffff,
+       {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+      {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+       0x299f31d0a4093822,
+       {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+  };
+
+  bool ok = true;
+  for (Vector const& v : vectors) {
+    tnzu::Philox::result_type const r = tnzu::Philox(v.key)(
+        v.counter[0], v.counter[1], v.counter[2], v.counter[3]);
+    for (int i = 0; i < 4; i++) {
+      if (r[i] != v.result[i]) {
+        std::fprintf(stderr, "Philox4x32-10: %08x != %08x\n", r[i],
+                     v.result[i]);
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+int usage(char const* argv0) {
+  std::fprintf(stderr,
+               "usage: %s [-n frames] [-j threads] [-i image] plugin...\n",
+               argv0);
+  return 2;
+}
+}
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:j:i:")) != -1) {
+    switch (opt) {
+      case 'n':
+        opts.frames = std::max(1, std::atoi(optarg));
+        break;
+      case 'j':
+        opts.threads = std::max(1, std::atoi(optarg));
+        break;
+      case 'i':
+        opts.image = optarg;
+        break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    opts.plugins.push_back(argv[i]);
+  }
+  if (opts.plugins.empty()) {
+    return usage(argv[0]);
+  }
+
+  if (!check_philox()) {
+    return 1;
+  }
+
+  std::vector<Case> cases;
+  for (cv::Size const size : {cv::Size(1920, 1080), cv::Size(3840, 2160)}) {
+    for (int const bpp : {32, 64}) {
+      for (int const tile : {0, 1024, 512, 256}) {
+        cases.push_back(Case{size, bpp, tile});
+      }
+    }
+  }
+
+  // stage columns are milliseconds per frame summed over threads, so they
+  // exceed the frame time when host threads render tiles at once
+  print_header();
+  bool ok = true;
+  for (std::string const& path : opts.plugins) {
+    for (Case const& c : cases) {
+      Result const r = fork_run(opts, path, c);
+      print_result(path, c, r);
+      ok = ok && r.ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -74,6 +74,25 @@ class MyFx : public tnzu::Fx {
     return 0;
   }
 
+  int require(Config const& config, Params const& params,
+              cv::Rect2d& retrc) override {
+    // the kernel is symmetric, so the inverse equals to the forward
+    return enlarge(config, params, retrc);
+  }
+
+  // cv::GaussianBlur() holds an intermediate image of the separable filter
+  int scratch_buffer_count() const override { return 1; }
+
+  bool use_subtiles() const override { return true; }
+
+  // swatches are blurred at half resolution, and upsampled
+  double proxy_scale(Config const& config) const override {
+    return config.is_swatch ? 0.5 : 1.0;
+  }
+
+  // all parameters are lengths in pixels
+  bool param_spatial(int i) const override { return true; }
+
   int compute(Config const& config, Params const& params, Args const& args,
               cv::Mat& retimg) override try {
     DEBUG_PRINT(__FUNCTION__);
@@ -88,12 +107,19 @@ class MyFx : public tnzu::Fx {
     double const sigmaX = params.get<double>(PARAM_SIGMA_X);
     double const sigmaY = params.get<double>(PARAM_SIGMA_Y);
 
-    args.get(PORT_INPUT).copyTo(retimg(args.rect(PORT_INPUT)));
-    cv::GaussianBlur(retimg, retimg, ksize, sigmaX, sigmaY);
+    // a sub-tile covers only its part of the input, so the input is blurred
+    // on a canvas of both
+    cv::Rect const in = args.rect(PORT_INPUT);
+    cv::Rect const out(0, 0, retimg.cols, retimg.rows);
+    cv::Rect const all = in | out;
+    cv::Mat canvas = cv::Mat::zeros(all.size(), retimg.type());
+    args.get(PORT_INPUT).copyTo(canvas(in - all.tl()));
+    cv::GaussianBlur(canvas, canvas, ksize, sigmaX, sigmaY);
+    canvas(out - all.tl()).copyTo(retimg);
 
     return 0;
   } catch (cv::Exception const& e) {
-    DEBUG_PRINT(e.what());
+    TNZU_LOG_ERROR(e.what());
   }
 };
 
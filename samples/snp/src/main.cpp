@@ -64,8 +64,11 @@ class MyFx : public tnzu::Fx {
     return 0;
   }
 
-  template <typename Vec4T, typename RNG>
-  int kernel(double const p, cv::Mat& retimg, RNG& rng);
+  int require(Config const& config, Params const& params,
+              cv::Rect2d& retrc) override {
+    // each pixel depends on the same pixel of the input
+    return 0;
+  }
 
   int compute(Config const& config, Params const& params, Args const& args,
               cv::Mat& retimg) override try {
@@ -76,43 +79,37 @@ class MyFx : public tnzu::Fx {
     }
 
     double const p = params.get<double>(PARAM_P);
-    std::mt19937_64 rng = params.rng<std::uint64_t>(PARAM_SEED);
+    std::uint64_t const seed = params.seed<std::uint64_t>(PARAM_SEED);
 
     tnzu::draw_image(retimg, args.get(PORT_INPUT), args.offset(PORT_INPUT));
 
-    if (retimg.type() == CV_8UC4) {
-      return kernel<cv::Vec4b>(p, retimg, rng);
-    } else {
-      return kernel<cv::Vec4w>(p, retimg, rng);
-    }
+    // drawn by positions in the output space, so that noise does not depend
+    // on tiles. the frame is fixed to keep the pattern still.
+    cv::Point const origin(static_cast<int>(std::floor(config.origin.x)),
+                           static_cast<int>(std::floor(config.origin.y)));
+    cv::Mat mask(retimg.size(), CV_8UC1);
+    tnzu::fill_bernoulli(mask, origin, seed, 0, p);
+
+    // rows are processed in parallel for either of 8 and 16 bits pixels
+    tnzu::for_each_pixel(
+        retimg, [&](auto& pixel, int x, int y, tnzu::Band& band) {
+          using value_type =
+              typename std::decay<decltype(pixel)>::type::value_type;
+          if (mask.at<std::uint8_t>(y, x)) {
+            int const alpha = pixel[3];
+            for (int c = 0; c < 3; ++c) {
+              // assume premultiplied alpha
+              pixel[c] = cv::saturate_cast<value_type>(alpha - pixel[c]);
+            }
+          }
+        });
+
+    return 0;
   } catch (cv::Exception const& e) {
-    DEBUG_PRINT(e.what());
+    TNZU_LOG_ERROR(e.what());
   }
 };
 
-template <typename Vec4T, typename RNG>
-int MyFx::kernel(double const p, cv::Mat& retimg, RNG& rng) {
-  using value_type = typename Vec4T::value_type;
-
-  std::bernoulli_distribution rbern(p);
-
-  for (int y = 0; y < retimg.rows; ++y) {
-    Vec4T* scanline = retimg.ptr<Vec4T>(y);
-    for (int x = 0; x < retimg.cols; ++x) {
-      if (rbern(rng)) {
-        int const alpha = scanline[x][3];
-        for (int c = 0; c < 3; ++c) {
-          // assume premultiplied alpha
-          scanline[x][c] =
-              cv::saturate_cast<value_type>(alpha - scanline[x][c]);
-        }
-      }
-    }
-  }
-
-  return 0;
-}
-
 namespace tnzu {
 PluginInfo const* plugin_info() {
   static PluginInfo const info(TNZU_PP_STR(PLUGIN_NAME),    // name
@@ -0,0 +1,263 @@
+#include <toonz_utility.hpp>
+
+#include <cstring>
+#include <vector>
+
+#include "kernels.hpp"
+
+namespace {
+// cf. https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+std::uint64_t const PRIME64_1 = 11400714785074694791LLU;
+std::uint64_t const PRIME64_2 = 14029467366897019727LLU;
+std::uint64_t const PRIME64_3 = 1609587929392839161LLU;
+std::uint64_t const PRIME64_4 = 9650029242287828579LLU;
+std::uint64_t const PRIME64_5 = 2870177450012600261LLU;
+
+// rows hashed by a task of tnzu::hash(), which does not depend on the number
+// of threads so that the hash code is stable
+int const BAND_ROWS = 32;
+
+inline std::uint64_t rotl(std::uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t read64(std::uint8_t const* p) {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline std::uint32_t read32(std::uint8_t const* p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl(acc, 31);
+  return acc * PRIME64_1;
+}
+
+inline std::uint64_t merge_round(std::uint64_t acc, std::uint64_t val) {
+  acc ^= round(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+// consumes 32-byte stripes by four independent lanes
+inline std::uint8_t const* consume(std::uint64_t* v, std::uint8_t const* p,
+                                   std::uint8_t const* end) {
+  std::uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+  for (; p + 32 <= end; p += 32) {
+    v0 = round(v0, read64(p + 0));
+    v1 = round(v1, read64(p + 8));
+    v2 = round(v2, read64(p + 16));
+    v3 = round(v3, read64(p + 24));
+  }
+  v[0] = v0;
+  v[1] = v1;
+  v[2] = v2;
+  v[3] = v3;
+  return p;
+}
+}
+
+namespace tnzu {
+Hasher::Hasher(std::uint64_t seed) : total_(0), buffered_(0), seed_(seed) {
+  v_[0] = seed + PRIME64_1 + PRIME64_2;
+  v_[1] = seed + PRIME64_2;
+  v_[2] = seed;
+  v_[3] = seed - PRIME64_1;
+}
+
+void Hasher::update(void const* data, std::size_t size) {
+  std::uint8_t const* p = static_cast<std::uint8_t const*>(data);
+  std::uint8_t const* const end = p + size;
+  total_ += size;
+
+  if (buffered_ + size < sizeof(buffer_)) {
+    std::memcpy(buffer_ + buffered_, p, size);
+    buffered_ += size;
+    return;
+  }
+
+  if (buffered_) {
+    std::size_t const fill = sizeof(buffer_) - buffered_;
+    std::memcpy(buffer_ + buffered_, p, fill);
+    consume(v_, buffer_, buffer_ + sizeof(buffer_));
+    p += fill;
+    buffered_ = 0;
+  }
+
+  p = consume(v_, p, end);
+
+  buffered_ = end - p;
+  std::memcpy(buffer_, p, buffered_);
+}
+
+void Hasher::update4(Hasher (&hashers)[4],
+                     std::uint8_t const* const (&data)[4], std::size_t size) {
+  // the hashers have buffered alike, since they have taken equal sizes
+  std::size_t const buffered = hashers[0].buffered_;
+  std::uint8_t const* p[4];
+  for (int j = 0; j < 4; ++j) {
+    hashers[j].total_ += size;
+    p[j] = data[j];
+  }
+
+  if (buffered + size < sizeof(buffer_)) {
+    for (int j = 0; j < 4; ++j) {
+      std::memcpy(hashers[j].buffer_ + buffered, p[j], size);
+      hashers[j].buffered_ += size;
+    }
+    return;
+  }
+
+  std::size_t rest = size;
+  if (buffered) {
+    std::size_t const fill = sizeof(buffer_) - buffered;
+    for (int j = 0; j < 4; ++j) {
+      Hasher& h = hashers[j];
+      std::memcpy(h.buffer_ + buffered, p[j], fill);
+      consume(h.v_, h.buffer_, h.buffer_ + sizeof(buffer_));
+      p[j] += fill;
+    }
+    rest -= fill;
+  }
+
+  int const stripes = static_cast<int>(rest / 32);
+  std::uint64_t acc[16];
+  for (int j = 0; j < 4; ++j) {
+    std::memcpy(acc + j * 4, hashers[j].v_, sizeof(hashers[j].v_));
+  }
+  tnzu::kernels::selected()->xxh64_stripes4(acc, p, stripes);
+  rest -= stripes * 32;
+
+  for (int j = 0; j < 4; ++j) {
+    Hasher& h = hashers[j];
+    std::memcpy(h.v_, acc + j * 4, sizeof(h.v_));
+    std::memcpy(h.buffer_, p[j] + stripes * 32, rest);
+    h.buffered_ = rest;
+  }
+}
+
+void Hasher::update(cv::Mat const& m) {
+  std::uint64_t const h = tnzu::hash(m);
+  update(&h, sizeof(h));
+}
+
+std::uint64_t Hasher::digest() const {
+  std::uint64_t h;
+  if (total_ >= sizeof(buffer_)) {
+    h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+    h = merge_round(h, v_[0]);
+    h = merge_round(h, v_[1]);
+    h = merge_round(h, v_[2]);
+    h = merge_round(h, v_[3]);
+  } else {
+    h = seed_ + PRIME64_5;
+  }
+
+  h += total_;
+
+  std::uint8_t const* p = buffer_;
+  std::uint8_t const* const end = buffer_ + buffered_;
+  for (; p + 8 <= end; p += 8) {
+    h ^= round(0, read64(p));
+    h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    h ^= read32(p) * PRIME64_1;
+    h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * PRIME64_5;
+    h = rotl(h, 11) * PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+std::size_t hash(cv::Mat const& m) {
+  std::int32_t const shape[] = {m.type(), m.cols, m.rows};
+
+  Hasher h;
+  h.update(shape, sizeof(shape));
+  if (m.empty()) {
+    return static_cast<std::size_t>(h.digest());
+  }
+
+  // bands of rows are hashed in parallel, and then their hash codes are
+  // hashed in order. a task hashes four full bands in step by SIMD, the
+  // last bands of the image one by one.
+  std::size_t const row_bytes = m.cols * m.elemSize();
+  int const bands = (m.rows + BAND_ROWS - 1) / BAND_ROWS;
+  int const full = m.rows / BAND_ROWS;
+  std::vector<std::uint64_t> codes(bands);
+  tnzu::parallel_for((bands + 3) / 4, 0, [&](int g) {
+    int const first = g * 4;
+    if (first + 4 <= full) {
+      Hasher band[4] = {Hasher(first), Hasher(first + 1), Hasher(first + 2),
+                        Hasher(first + 3)};
+      for (int y = first * BAND_ROWS, end = y + BAND_ROWS; y < end; ++y) {
+        std::uint8_t const* const rows[4] = {
+            m.ptr(y), m.ptr(y + BAND_ROWS), m.ptr(y + BAND_ROWS * 2),
+            m.ptr(y + BAND_ROWS * 3)};
+        Hasher::update4(band, rows, row_bytes);
+      }
+      for (int j = 0; j < 4; ++j) {
+        codes[first + j] = band[j].digest();
+      }
+      return;
+    }
+
+    for (int k = first, last = std::min(first + 4, bands); k < last; ++k) {
+      Hasher band(k);
+      for (int y = k * BAND_ROWS, end = std::min(y + BAND_ROWS, m.rows);
+           y < end; ++y) {
+        band.update(m.ptr(y), row_bytes);
+      }
+      codes[k] = band.digest();
+    }
+  });
+
+  h.update(codes.data(), codes.size() * sizeof(std::uint64_t));
+  return static_cast<std::size_t>(h.digest());
+}
+
+std::size_t hash(cv::Mat const& m, cv::Rect const& roi) {
+  return tnzu::hash(m(roi & cv::Rect(0, 0, m.cols, m.rows)));
+}
+
+std::size_t probable_hash(cv::Mat const& m) {
+  static std::size_t const FNV_OFFSET_BASIS = 14695981039346656037LLU;
+  static std::size_t const FNV_PRIME = 1099511628211LLU;
+  static std::size_t const SAMPLE_SIZE = 256;
+
+  std::size_t const row_bytes = m.cols * m.elemSize();
+  std::size_t const size = m.rows * row_bytes;
+  if (!size) {
+    return FNV_OFFSET_BASIS;
+  }
+
+  // sample by Van der Corput sequence
+  std::size_t h = FNV_OFFSET_BASIS;
+  for (std::size_t i = 1; i <= SAMPLE_SIZE; ++i) {
+    // sample point
+    double const j =
+        tnzu::bit_reverse(i) / (std::numeric_limits<std::size_t>::max() + 1.0);
+    std::size_t const k = static_cast<std::size_t>(j * size);
+
+    // update hash value
+    h *= FNV_PRIME;
+    h ^= m.ptr(static_cast<int>(k / row_bytes))[k % row_bytes];
+  }
+  return h;
+}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+// row kernels of the library, built once per instruction set in separate
+// translation units (kernels_*.cpp) and chosen at run time.
+//
+// the translation units are compiled with different target flags, so they
+// must not share out-of-line code: helpers here have internal linkage, and
+// the kernels avoid templates of the standard library and OpenCV, whose
+// instances the linker could take from any of them.
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TNZU_USE_SSE2
+#include <emmintrin.h>
+#else
+#include <cmath>
+#endif
+
+namespace tnzu {
+namespace kernels {
+struct Table {
+  char const* name;
+
+  // premultiplied "over" of `width` BGRA pixels of `src` onto `dst`
+  void (*over_row8)(std::uint8_t* dst, std::uint8_t const* src, int width);
+  void (*over_row16)(std::uint16_t* dst, std::uint16_t const* src,
+                     int width);
+
+  // dst[i] = src[i] * scale for `n` values
+  void (*u8_to_f32)(float* dst, std::uint8_t const* src, int n, float scale);
+  void (*u16_to_f32)(float* dst, std::uint16_t const* src, int n,
+                     float scale);
+
+  // dst[i] = cv::saturate_cast(src[i] * scale) for `n` values
+  void (*f32_to_u8)(std::uint8_t* dst, float const* src, int n, float scale);
+  void (*f32_to_u16)(std::uint16_t* dst, float const* src, int n,
+                     float scale);
+
+  // advances four xxHash64 states, acc[j * 4 + 0..3] for j in [0, 4), by
+  // `stripes` 32-byte stripes of src[j]
+  void (*xxh64_stripes4)(std::uint64_t* acc, std::uint8_t const* const* src,
+                         int stripes);
+};
+
+// SSE2 on x86, or portable code elsewhere. always available.
+Table const* baseline();
+
+// null unless the library is built for the instruction set
+Table const* avx2();
+Table const* avx512();
+
+// the variant chosen for the CPU at plugin init
+Table const* selected();
+}
+}
+
+namespace {
+// premultiplied "over" of a channel: d * (max - a) / max + s.
+// the division is exact for every product of two channel values and the sum
+// wraps like the plain integer expression for non-premultiplied sources.
+inline std::uint8_t over_channel(std::uint8_t d, std::uint8_t s,
+                                 std::uint8_t a) {
+  std::uint32_t const p = std::uint32_t(d) * (0xffu - a);
+  return static_cast<std::uint8_t>(((p + (p >> 8) + 1) >> 8) + s);
+}
+
+inline std::uint16_t over_channel(std::uint16_t d, std::uint16_t s,
+                                  std::uint16_t a) {
+  std::uint32_t const p = std::uint32_t(d) * (0xffffu - a);
+  return static_cast<std::uint16_t>(((p + (p >> 16) + 1) >> 16) + s);
+}
+
+template <typename T>
+inline void over_pixels(T* dst, T const* src, int begin, int end) {
+  for (int x = begin; x < end; ++x) {
+    T const a = src[x * 4 + 3];
+    for (int c = 0; c < 4; ++c) {
+      dst[x * 4 + c] = over_channel(dst[x * 4 + c], src[x * 4 + c], a);
+    }
+  }
+}
+
+// cvRound() of OpenCV, which rounds half to even by SSE2 on x86
+inline int round_int(float v) {
+#ifdef TNZU_USE_SSE2
+  return _mm_cvtss_si32(_mm_set_ss(v));
+#else
+  return static_cast<int>(std::nearbyint(v));
+#endif
+}
+
+template <typename T>
+inline void to_float(float* dst, T const* src, int begin, int end,
+                     float scale) {
+  for (int i = begin; i < end; ++i) {
+    dst[i] = src[i] * scale;
+  }
+}
+
+// cf. https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+std::uint64_t const XXH64_PRIME_1 = 11400714785074694791LLU;
+std::uint64_t const XXH64_PRIME_2 = 14029467366897019727LLU;
+
+inline std::uint64_t xxh64_round(std::uint64_t acc, std::uint8_t const* p) {
+  std::uint64_t input;
+  std::memcpy(&input, p, sizeof(input));
+  acc += input * XXH64_PRIME_2;
+  acc = (acc << 31) | (acc >> 33);
+  return acc * XXH64_PRIME_1;
+}
+
+template <typename T, int Max>
+inline void from_float(T* dst, float const* src, int begin, int end,
+                       float scale) {
+  for (int i = begin; i < end; ++i) {
+    int const v = round_int(src[i] * scale);
+    dst[i] = static_cast<T>((v < 0) ? 0 : (v > Max) ? Max : v);
+  }
+}
+}
@@ -0,0 +1,163 @@
+#include "kernels.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace {
+// copies the 4th lane of each group of four 16-bit lanes to the others
+inline __m256i broadcast_alpha(__m256i v) {
+  return _mm256_shufflehi_epi16(
+      _mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)),
+      _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// unpacking and packing work within 128-bit lanes, so pairs of them keep the
+// order of pixels
+void over_row8(std::uint8_t* dst, std::uint8_t const* src, int width) {
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const one = _mm256_set1_epi16(1);
+  __m256i const max = _mm256_set1_epi16(0xff);
+
+  auto const over = [&](__m256i d, __m256i s) {
+    __m256i const a = broadcast_alpha(s);
+    __m256i const p = _mm256_mullo_epi16(d, _mm256_xor_si256(a, max));
+    __m256i const q = _mm256_srli_epi16(
+        _mm256_add_epi16(_mm256_add_epi16(p, _mm256_srli_epi16(p, 8)), one),
+        8);
+    return _mm256_and_si256(_mm256_add_epi16(q, s), max);
+  };
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i const d =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(dst + x * 4));
+    __m256i const s =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + x * 4));
+    __m256i const lo =
+        over(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+    __m256i const hi =
+        over(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4),
+                        _mm256_packus_epi16(lo, hi));
+  }
+  over_pixels(dst, src, x, width);
+}
+
+void over_row16(std::uint16_t* dst, std::uint16_t const* src, int width) {
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const one = _mm256_set1_epi32(1);
+  __m256i const max = _mm256_set1_epi16(-1);
+
+  // low 16 bits of (p / max + s) for 32-bit products `p`
+  auto const over = [&](__m256i p, __m256i s) {
+    __m256i const q = _mm256_srli_epi32(
+        _mm256_add_epi32(_mm256_add_epi32(p, _mm256_srli_epi32(p, 16)), one),
+        16);
+    return _mm256_srai_epi32(_mm256_slli_epi32(_mm256_add_epi32(q, s), 16),
+                             16);
+  };
+
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m256i const d =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(dst + x * 4));
+    __m256i const s =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + x * 4));
+    __m256i const b = _mm256_xor_si256(broadcast_alpha(s), max);
+    __m256i const lo = _mm256_mullo_epi16(d, b);
+    __m256i const hi = _mm256_mulhi_epu16(d, b);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst + x * 4),
+        _mm256_packs_epi32(over(_mm256_unpacklo_epi16(lo, hi),
+                                _mm256_unpacklo_epi16(s, zero)),
+                           over(_mm256_unpackhi_epi16(lo, hi),
+                                _mm256_unpackhi_epi16(s, zero))));
+  }
+  over_pixels(dst, src, x, width);
+}
+
+void u8_to_f32(float* dst, std::uint8_t const* src, int n, float scale) {
+  __m256 const k = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i const v = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+  }
+  to_float(dst, src, i, n, scale);
+}
+
+void u16_to_f32(float* dst, std::uint16_t const* src, int n, float scale) {
+  __m256 const k = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i const v = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+  }
+  to_float(dst, src, i, n, scale);
+}
+
+void f32_to_u8(std::uint8_t* dst, float const* src, int n, float scale) {
+  __m256 const k = _mm256_set1_ps(scale);
+  // packing interleaves 128-bit lanes, 4-byte groups are put back in order
+  __m256i const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v[4];
+    for (int j = 0; j < 4; ++j) {
+      v[j] = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(src + i + j * 8), k));
+    }
+    __m256i const packed =
+        _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]),
+                            _mm256_packs_epi32(v[2], v[3]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_permutevar8x32_epi32(packed, order));
+  }
+  from_float<std::uint8_t, 0xff>(dst, src, i, n, scale);
+}
+
+void f32_to_u16(std::uint16_t* dst, float const* src, int n, float scale) {
+  __m256 const k = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i const lo =
+        _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src + i), k));
+    __m256i const hi =
+        _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), k));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst + i),
+        _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi),
+                                 _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  from_float<std::uint16_t, 0xffff>(dst, src, i, n, scale);
+}
+
+// AVX2 has no multiplication of 64-bit lanes, and products of 32-bit halves
+// cost more than the scalar lanes of the baseline. they are called there, as
+// the compiler would vectorize them by those products in this unit.
+void xxh64_stripes4(std::uint64_t* acc, std::uint8_t const* const* src,
+                    int stripes) {
+  tnzu::kernels::baseline()->xxh64_stripes4(acc, src, stripes);
+}
+
+tnzu::kernels::Table const table = {
+    "avx2",
+    over_row8, over_row16, u8_to_f32, u16_to_f32, f32_to_u8, f32_to_u16,
+    xxh64_stripes4,
+};
+}
+#endif
+
+namespace tnzu {
+namespace kernels {
+Table const* avx2() {
+#ifdef __AVX2__
+  return &table;
+#else
+  return nullptr;
+#endif
+}
+}
+}
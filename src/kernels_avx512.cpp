@@ -0,0 +1,170 @@
+#include "kernels.hpp"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__)
+#include <immintrin.h>
+
+namespace {
+// copies the 4th lane of each group of four 16-bit lanes to the others
+inline __m512i broadcast_alpha(__m512i v) {
+  return _mm512_shufflehi_epi16(
+      _mm512_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)),
+      _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// unpacking and packing work within 128-bit lanes, so pairs of them keep the
+// order of pixels
+void over_row8(std::uint8_t* dst, std::uint8_t const* src, int width) {
+  __m512i const zero = _mm512_setzero_si512();
+  __m512i const one = _mm512_set1_epi16(1);
+  __m512i const max = _mm512_set1_epi16(0xff);
+
+  auto const over = [&](__m512i d, __m512i s) {
+    __m512i const a = broadcast_alpha(s);
+    __m512i const p = _mm512_mullo_epi16(d, _mm512_xor_si512(a, max));
+    __m512i const q = _mm512_srli_epi16(
+        _mm512_add_epi16(_mm512_add_epi16(p, _mm512_srli_epi16(p, 8)), one),
+        8);
+    return _mm512_and_si512(_mm512_add_epi16(q, s), max);
+  };
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m512i const d = _mm512_loadu_si512(dst + x * 4);
+    __m512i const s = _mm512_loadu_si512(src + x * 4);
+    __m512i const lo =
+        over(_mm512_unpacklo_epi8(d, zero), _mm512_unpacklo_epi8(s, zero));
+    __m512i const hi =
+        over(_mm512_unpackhi_epi8(d, zero), _mm512_unpackhi_epi8(s, zero));
+    _mm512_storeu_si512(dst + x * 4, _mm512_packus_epi16(lo, hi));
+  }
+  over_pixels(dst, src, x, width);
+}
+
+void over_row16(std::uint16_t* dst, std::uint16_t const* src, int width) {
+  __m512i const zero = _mm512_setzero_si512();
+  __m512i const one = _mm512_set1_epi32(1);
+  __m512i const max = _mm512_set1_epi16(-1);
+
+  // low 16 bits of (p / max + s) for 32-bit products `p`
+  auto const over = [&](__m512i p, __m512i s) {
+    __m512i const q = _mm512_srli_epi32(
+        _mm512_add_epi32(_mm512_add_epi32(p, _mm512_srli_epi32(p, 16)), one),
+        16);
+    return _mm512_srai_epi32(_mm512_slli_epi32(_mm512_add_epi32(q, s), 16),
+                             16);
+  };
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m512i const d = _mm512_loadu_si512(dst + x * 4);
+    __m512i const s = _mm512_loadu_si512(src + x * 4);
+    __m512i const b = _mm512_xor_si512(broadcast_alpha(s), max);
+    __m512i const lo = _mm512_mullo_epi16(d, b);
+    __m512i const hi = _mm512_mulhi_epu16(d, b);
+    _mm512_storeu_si512(
+        dst + x * 4,
+        _mm512_packs_epi32(over(_mm512_unpacklo_epi16(lo, hi),
+                                _mm512_unpacklo_epi16(s, zero)),
+                           over(_mm512_unpackhi_epi16(lo, hi),
+                                _mm512_unpackhi_epi16(s, zero))));
+  }
+  over_pixels(dst, src, x, width);
+}
+
+void u8_to_f32(float* dst, std::uint8_t const* src, int n, float scale) {
+  __m512 const k = _mm512_set1_ps(scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i const v = _mm512_cvtepu8_epi32(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i)));
+    _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), k));
+  }
+  to_float(dst, src, i, n, scale);
+}
+
+void u16_to_f32(float* dst, std::uint16_t const* src, int n, float scale) {
+  __m512 const k = _mm512_set1_ps(scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i const v = _mm512_cvtepu16_epi32(
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i)));
+    _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), k));
+  }
+  to_float(dst, src, i, n, scale);
+}
+
+// negative values, and out of range ones which convert to INT_MIN, are
+// clamped to zero before the unsigned saturation
+inline __m512i to_unsigned(float const* src, __m512 k) {
+  return _mm512_max_epi32(
+      _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_loadu_ps(src), k)),
+      _mm512_setzero_si512());
+}
+
+void f32_to_u8(std::uint8_t* dst, float const* src, int n, float scale) {
+  __m512 const k = _mm512_set1_ps(scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm512_cvtusepi32_epi8(to_unsigned(src + i, k)));
+  }
+  from_float<std::uint8_t, 0xff>(dst, src, i, n, scale);
+}
+
+void f32_to_u16(std::uint16_t* dst, float const* src, int n, float scale) {
+  __m512 const k = _mm512_set1_ps(scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm512_cvtusepi32_epi16(to_unsigned(src + i, k)));
+  }
+  from_float<std::uint16_t, 0xffff>(dst, src, i, n, scale);
+}
+
+// a register holds two states, the pairs are interleaved to hide the latency
+// of the multiplications
+void xxh64_stripes4(std::uint64_t* acc, std::uint8_t const* const* src,
+                    int stripes) {
+  __m512i const p1 = _mm512_set1_epi64(static_cast<long long>(XXH64_PRIME_1));
+  __m512i const p2 = _mm512_set1_epi64(static_cast<long long>(XXH64_PRIME_2));
+
+  __m512i v[2];
+  for (int j = 0; j < 2; ++j) {
+    v[j] = _mm512_loadu_si512(acc + j * 8);
+  }
+  for (int k = 0; k < stripes; ++k) {
+    for (int j = 0; j < 2; ++j) {
+      __m512i const input = _mm512_inserti64x4(
+          _mm512_castsi256_si512(_mm256_loadu_si256(
+              reinterpret_cast<__m256i const*>(src[j * 2] + k * 32))),
+          _mm256_loadu_si256(
+              reinterpret_cast<__m256i const*>(src[j * 2 + 1] + k * 32)),
+          1);
+      __m512i const a = _mm512_add_epi64(v[j], _mm512_mullo_epi64(input, p2));
+      v[j] = _mm512_mullo_epi64(_mm512_rol_epi64(a, 31), p1);
+    }
+  }
+  for (int j = 0; j < 2; ++j) {
+    _mm512_storeu_si512(acc + j * 8, v[j]);
+  }
+}
+
+tnzu::kernels::Table const table = {
+    "avx512",
+    over_row8, over_row16, u8_to_f32, u16_to_f32, f32_to_u8, f32_to_u16,
+    xxh64_stripes4,
+};
+}
+#endif
+
+namespace tnzu {
+namespace kernels {
+Table const* avx512() {
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__)
+  return &table;
+#else
+  return nullptr;
+#endif
+}
+}
+}
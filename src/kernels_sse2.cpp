@@ -0,0 +1,196 @@
+#include "kernels.hpp"
+
+namespace {
+#ifdef TNZU_USE_SSE2
+// copies the 4th lane of each group of four 16-bit lanes to the others
+inline __m128i broadcast_alpha(__m128i v) {
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)),
+                             _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+void over_row8(std::uint8_t* dst, std::uint8_t const* src, int width) {
+  int x = 0;
+#ifdef TNZU_USE_SSE2
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const one = _mm_set1_epi16(1);
+  __m128i const max = _mm_set1_epi16(0xff);
+
+  auto const over = [&](__m128i d, __m128i s) {
+    __m128i const a = broadcast_alpha(s);
+    __m128i const p = _mm_mullo_epi16(d, _mm_xor_si128(a, max));
+    __m128i const q = _mm_srli_epi16(
+        _mm_add_epi16(_mm_add_epi16(p, _mm_srli_epi16(p, 8)), one), 8);
+    return _mm_and_si128(_mm_add_epi16(q, s), max);
+  };
+
+  for (; x + 4 <= width; x += 4) {
+    __m128i const d =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst + x * 4));
+    __m128i const s =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + x * 4));
+    __m128i const lo =
+        over(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+    __m128i const hi =
+        over(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),
+                     _mm_packus_epi16(lo, hi));
+  }
+#endif
+  over_pixels(dst, src, x, width);
+}
+
+void over_row16(std::uint16_t* dst, std::uint16_t const* src, int width) {
+  int x = 0;
+#ifdef TNZU_USE_SSE2
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const one = _mm_set1_epi32(1);
+  __m128i const max = _mm_set1_epi16(-1);
+
+  // low 16 bits of (p / max + s) for 32-bit products `p`
+  auto const over = [&](__m128i p, __m128i s) {
+    __m128i const q = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(p, _mm_srli_epi32(p, 16)), one), 16);
+    return _mm_srai_epi32(_mm_slli_epi32(_mm_add_epi32(q, s), 16), 16);
+  };
+
+  for (; x + 2 <= width; x += 2) {
+    __m128i const d =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst + x * 4));
+    __m128i const s =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + x * 4));
+    __m128i const a = broadcast_alpha(s);
+    __m128i const b = _mm_xor_si128(a, max);
+    __m128i const lo = _mm_mullo_epi16(d, b);
+    __m128i const hi = _mm_mulhi_epu16(d, b);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst + x * 4),
+        _mm_packs_epi32(
+            over(_mm_unpacklo_epi16(lo, hi), _mm_unpacklo_epi16(s, zero)),
+            over(_mm_unpackhi_epi16(lo, hi), _mm_unpackhi_epi16(s, zero))));
+  }
+#endif
+  over_pixels(dst, src, x, width);
+}
+
+void u8_to_f32(float* dst, std::uint8_t const* src, int n, float scale) {
+  int i = 0;
+#ifdef TNZU_USE_SSE2
+  __m128i const zero = _mm_setzero_si128();
+  __m128 const k = _mm_set1_ps(scale);
+  for (; i + 16 <= n; i += 16) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+    __m128i const lo = _mm_unpacklo_epi8(v, zero);
+    __m128i const hi = _mm_unpackhi_epi8(v, zero);
+    __m128i const w[4] = {
+        _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+        _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero),
+    };
+    for (int j = 0; j < 4; ++j) {
+      _mm_storeu_ps(dst + i + j * 4, _mm_mul_ps(_mm_cvtepi32_ps(w[j]), k));
+    }
+  }
+#endif
+  to_float(dst, src, i, n, scale);
+}
+
+void u16_to_f32(float* dst, std::uint16_t const* src, int n, float scale) {
+  int i = 0;
+#ifdef TNZU_USE_SSE2
+  __m128i const zero = _mm_setzero_si128();
+  __m128 const k = _mm_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+    _mm_storeu_ps(dst + i,
+                  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), k));
+    _mm_storeu_ps(dst + i + 4,
+                  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), k));
+  }
+#endif
+  to_float(dst, src, i, n, scale);
+}
+
+void f32_to_u8(std::uint8_t* dst, float const* src, int n, float scale) {
+  int i = 0;
+#ifdef TNZU_USE_SSE2
+  __m128 const k = _mm_set1_ps(scale);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v[4];
+    for (int j = 0; j < 4; ++j) {
+      v[j] = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + j * 4), k));
+    }
+    // saturates through int16_t, which keeps every value of uint8_t
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]),
+                                      _mm_packs_epi32(v[2], v[3])));
+  }
+#endif
+  from_float<std::uint8_t, 0xff>(dst, src, i, n, scale);
+}
+
+#ifdef TNZU_USE_SSE2
+// clamps int32_t lanes to [0, 65535], and biases them to int16_t
+inline __m128i to_biased_u16(__m128i v) {
+  __m128i const max = _mm_set1_epi32(0xffff);
+  v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+  __m128i const over = _mm_cmpgt_epi32(v, max);
+  v = _mm_or_si128(_mm_andnot_si128(over, v), _mm_and_si128(over, max));
+  return _mm_sub_epi32(v, _mm_set1_epi32(0x8000));
+}
+#endif
+
+void f32_to_u16(std::uint16_t* dst, float const* src, int n, float scale) {
+  int i = 0;
+#ifdef TNZU_USE_SSE2
+  __m128 const k = _mm_set1_ps(scale);
+  __m128i const bias = _mm_set1_epi16(-0x8000);
+  for (; i + 8 <= n; i += 8) {
+    __m128i const lo = to_biased_u16(
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), k)));
+    __m128i const hi = to_biased_u16(
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), k)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_xor_si128(_mm_packs_epi32(lo, hi), bias));
+  }
+#endif
+  from_float<std::uint16_t, 0xffff>(dst, src, i, n, scale);
+}
+
+// SSE2 has no multiplication of 64-bit lanes, the lanes are scalar
+void xxh64_stripes4(std::uint64_t* acc, std::uint8_t const* const* src,
+                    int stripes) {
+  for (int j = 0; j < 4; ++j) {
+    std::uint64_t* const v = acc + j * 4;
+    std::uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    for (std::uint8_t const *p = src[j], *end = p + stripes * 32; p < end;
+         p += 32) {
+      v0 = xxh64_round(v0, p + 0);
+      v1 = xxh64_round(v1, p + 8);
+      v2 = xxh64_round(v2, p + 16);
+      v3 = xxh64_round(v3, p + 24);
+    }
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+  }
+}
+
+tnzu::kernels::Table const table = {
+#ifdef TNZU_USE_SSE2
+    "sse2",
+#else
+    "portable",
+#endif
+    over_row8, over_row16, u8_to_f32, u16_to_f32, f32_to_u8, f32_to_u16,
+    xxh64_stripes4,
+};
+}
+
+namespace tnzu {
+namespace kernels {
+Table const* baseline() { return &table; }
+}
+}
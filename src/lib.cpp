@@ -1,15 +1,43 @@
 #include <toonz_utility.hpp>
 
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <cmath>
 #include <vector>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <exception>
+#include <future>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <typeindex>
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include <toonz_params.h>
 
+#include "kernels.hpp"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
 namespace {
 
 std::string get_system_var(char const* key, char const* value) {
@@ -17,7 +45,7 @@ std::string get_system_var(char const* key, char const* value) {
   HKEY hKey = nullptr;
   if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, key, NULL, KEY_QUERY_VALUE, &hKey) !=
       ERROR_SUCCESS) {
-    DEBUG_PRINT("ERROR could not get a reg key");
+    TNZU_LOG_ERROR("could not get a reg key");
     return ".";
   }
 
@@ -26,7 +54,7 @@ std::string get_system_var(char const* key, char const* value) {
   DWORD dwDataSize = lpData.size();
   if (::RegQueryValueEx(hKey, value, 0, &dwType, lpData.data(), &dwDataSize) !=
       ERROR_SUCCESS) {
-    DEBUG_PRINT("ERROR could not get a reg value");
+    TNZU_LOG_ERROR("could not get a reg value");
   }
 
   return reinterpret_cast<char const*>(lpData.data());
@@ -58,7 +86,7 @@ std::unique_ptr<T, decltype(&release_interf)> grab_interf(
   do {                                           \
     Name = grab_interf<Type>(UUID);              \
     if (!Name) {                                 \
-      DEBUG_PRINT("ERROR could not get " #Name); \
+      TNZU_LOG_ERROR("could not get " #Name);    \
       return TOONZ_ERROR_FAILED_TO_CREATE;       \
     }                                            \
   \
@@ -123,532 +151,3210 @@ toonz_param_page_t build_page(char const* label, std::size_t n,
   return page;
 }
 
+// rows of an image are processed in bands of at least this many pixels, so
+// small images such as swatches are not split.
+int const band_pixels = 1 << 16;
+
+// calls `f(begin, end)` for bands of rows [begin, end) of an image of `size`
+void parallel_bands(cv::Size size, std::function<void(int, int)> const& f) {
+  int const rows = std::max(1, band_pixels / std::max(1, size.width));
+  tnzu::parallel_for((size.height + rows - 1) / rows, 0, [&](int k) {
+    f(k * rows, std::min(size.height, (k + 1) * rows));
+  });
+}
+
+// bytes of a pixel of `format`, whose tile pixels have `native` bytes
+inline std::size_t pixel_bytes(tnzu::Fx::PixelFormat format,
+                               std::size_t native) {
+  return (format == tnzu::Fx::PIXEL_FORMAT_NATIVE) ? native
+                                                   : 4 * sizeof(float);
+}
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+// recycles buffers of images between tiles and frames. buffers are kept in
+// buckets of sizes rounded up to quarters of powers of two, and released when
+// the last node ends rendering, or when idle ones exceed the limit.
+class BufferPool : public cv::MatAllocator {
+ public:
+  // smaller buffers come from cv::fastMalloc() directly
+  static std::size_t const min_bytes = 1 << 16;
+
+  static std::size_t const huge_page_bytes = 1 << 21;
+
+  static BufferPool& instance() {
+    // never destroyed, as images of the pool may outlive static objects
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+  }
+
+  BufferPool()
+      : limit_(std::size_t(1) << 30),
+        huge_pages_(false),
+        pooled_bytes_(0),
+        live_bytes_(0),
+        hits_(0),
+        misses_(0) {}
+
+  cv::UMatData* allocate(int dims, int const* sizes, int type, void* data,
+                         std::size_t* step, AccessFlags,
+                         cv::UMatUsageFlags) const override {
+    std::size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+      if (step) {
+        if (data && (step[i] != CV_AUTOSTEP)) {
+          CV_Assert(total <= step[i]);
+          total = step[i];
+        } else {
+          step[i] = total;
+        }
+      }
+      total *= sizes[i];
+    }
+
+    cv::UMatData* u = new cv::UMatData(this);
+    u->size = total;
+    if (data) {
+      u->flags |= cv::UMatData::USER_ALLOCATED;
+    } else {
+      data = acquire(total, u->allocatorFlags_);
+    }
+    u->data = u->origdata = static_cast<std::uint8_t*>(data);
+    return u;
+  }
+
+  bool allocate(cv::UMatData* u, AccessFlags,
+                cv::UMatUsageFlags) const override {
+    return u != nullptr;
+  }
+
+  void deallocate(cv::UMatData* u) const override {
+    if (!u) {
+      return;
+    }
+    CV_Assert((u->urefcount == 0) && (u->refcount == 0));
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+      recycle(u->origdata, u->size, u->allocatorFlags_);
+      u->origdata = nullptr;
+    }
+    delete u;
+  }
+
+  void set_limit(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = bytes;
+    shrink(limit_);
+  }
+
+  void set_huge_pages(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    huge_pages_ = enable;
+  }
+
+  // releases idle buffers
+  void trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shrink(0);
+  }
+
+  tnzu::BufferPoolStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tnzu::BufferPoolStats const stats = {pooled_bytes_, live_bytes_, hits_,
+                                         misses_};
+    return stats;
+  }
+
+ private:
+  // a buffer of a bucket. `mapped` buffers are backed by huge pages.
+  struct Block {
+    void* data;
+    bool mapped;
+  };
+
+  // bytes of the bucket of `bytes`
+  static std::size_t bucket_bytes(std::size_t bytes) {
+    std::size_t half = min_bytes / 2;
+    while (half * 2 < bytes) {
+      half *= 2;
+    }
+    std::size_t const quarter = half / 4;
+    return half + (bytes - half + quarter - 1) / quarter * quarter;
+  }
+
+  static std::size_t mapped_bytes(std::size_t bytes) {
+    return (bytes + huge_page_bytes - 1) & ~(huge_page_bytes - 1);
+  }
+
+  void* acquire(std::size_t bytes, int& mapped) const {
+    if (bytes < min_bytes) {
+      mapped = 0;
+      return cv::fastMalloc(bytes);
+    }
+
+    std::size_t const n = bucket_bytes(bytes);
+    bool huge_pages = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      live_bytes_ += n;
+      std::vector<Block>& bucket = buckets_[n];
+      if (!bucket.empty()) {
+        Block const block = bucket.back();
+        bucket.pop_back();
+        pooled_bytes_ -= n;
+        ++hits_;
+        mapped = block.mapped;
+        return block.data;
+      }
+      ++misses_;
+      huge_pages = huge_pages_;
+    }
+
+    if (huge_pages && (n >= huge_page_bytes)) {
+      if (void* data = map(n)) {
+        mapped = 1;
+        return data;
+      }
+    }
+    mapped = 0;
+    return cv::fastMalloc(n);
+  }
+
+  void recycle(void* data, std::size_t bytes, int mapped) const {
+    if (bytes < min_bytes) {
+      cv::fastFree(data);
+      return;
+    }
+
+    std::size_t const n = bucket_bytes(bytes);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      live_bytes_ -= n;
+      if (pooled_bytes_ + n <= limit_) {
+        Block const block = {data, mapped != 0};
+        buckets_[n].push_back(block);
+        pooled_bytes_ += n;
+        return;
+      }
+    }
+    release(data, n, mapped != 0);
+  }
+
+  // releases idle buffers until `bytes` are left. called with `mutex_` held.
+  void shrink(std::size_t bytes) const {
+    for (auto& bucket : buckets_) {
+      while ((pooled_bytes_ > bytes) && !bucket.second.empty()) {
+        Block const block = bucket.second.back();
+        bucket.second.pop_back();
+        pooled_bytes_ -= bucket.first;
+        release(block.data, bucket.first, block.mapped);
+      }
+    }
+  }
+
+  // anonymous memory aligned to huge pages, which the kernel may back by
+  // transparent huge pages. Linux only.
+  static void* map(std::size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    std::size_t const size = mapped_bytes(bytes);
+    void* const p = mmap(nullptr, size + huge_page_bytes,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+    if (p == MAP_FAILED) {
+      return nullptr;
+    }
+
+    // unmaps the unaligned head and the tail
+    std::uintptr_t const begin = reinterpret_cast<std::uintptr_t>(p);
+    std::uintptr_t const aligned =
+        (begin + huge_page_bytes - 1) & ~std::uintptr_t(huge_page_bytes - 1);
+    if (aligned > begin) {
+      munmap(p, aligned - begin);
+    }
+    munmap(reinterpret_cast<void*>(aligned + size),
+           begin + huge_page_bytes - aligned);
+
+    void* const data = reinterpret_cast<void*>(aligned);
+    madvise(data, size, MADV_HUGEPAGE);
+    return data;
+#else
+    (void)bytes;
+    return nullptr;
+#endif
+  }
+
+  static void release(void* data, std::size_t bytes, bool mapped) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (mapped) {
+      munmap(data, mapped_bytes(bytes));
+      return;
+    }
+#else
+    (void)bytes;
+    (void)mapped;
+#endif
+    cv::fastFree(data);
+  }
+
+  mutable std::mutex mutex_;
+  mutable std::map<std::size_t, std::vector<Block>> buckets_;
+  std::size_t limit_;  // of idle buffers
+  bool huge_pages_;
+  mutable std::size_t pooled_bytes_;
+  mutable std::size_t live_bytes_;
+  mutable std::uint64_t hits_;
+  mutable std::uint64_t misses_;
+};
+
+// (re)allocates `mat` from the buffer pool, unless it is of `size` and `type`
+void create_pooled(cv::Mat& mat, cv::Size size, int type) {
+  if ((mat.size() != size) || (mat.type() != type)) {
+    mat.release();
+    mat.allocator = &BufferPool::instance();
+  }
+  mat.create(size, type);
+}
+
+// a zero cleared image from the buffer pool
+cv::Mat zeros_pooled(cv::Size size, int type) {
+  cv::Mat mat;
+  create_pooled(mat, size, type);
+  mat = cv::Scalar::all(0);
+  return mat;
+}
+
+// row kernels for the instruction sets of the CPU, cf. select_kernels()
+tnzu::kernels::Table const* row_kernels = tnzu::kernels::baseline();
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || \
+    defined(_M_X64)
+// registers of CPUID leaf `leaf`, subleaf `sub`
+void cpuid(unsigned leaf, unsigned sub, unsigned regs[4]) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, static_cast<int>(leaf), static_cast<int>(sub));
+  for (int i = 0; i < 4; i++) {
+    regs[i] = static_cast<unsigned>(r[i]);
+  }
+#else
+  regs[0] = regs[1] = regs[2] = regs[3] = 0;
+  __get_cpuid_count(leaf, sub, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+}
+
+// register states the OS saves on context switches
+unsigned long long xcr0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  unsigned lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+
+// whether the CPU and the OS support the variant `table`
+bool supports(tnzu::kernels::Table const* table) {
+  if (!table) {
+    return false;
+  }
+  if (table == tnzu::kernels::baseline()) {
+    return true;
+  }
+
+  unsigned regs[4];
+  cpuid(0, 0, regs);
+  unsigned const max_leaf = regs[0];
+  cpuid(1, 0, regs);
+  bool const osxsave = (regs[2] & (1u << 27)) != 0;
+  bool const avx = (regs[2] & (1u << 28)) != 0;
+  // XMM and YMM states
+  if (max_leaf < 7 || !osxsave || !avx || ((xcr0() & 0x6) != 0x6)) {
+    return false;
+  }
+
+  cpuid(7, 0, regs);
+  if (table == tnzu::kernels::avx2()) {
+    return (regs[1] & (1u << 5)) != 0;
+  }
+  if (table == tnzu::kernels::avx512()) {
+    // AVX512F, AVX512DQ and AVX512BW, with opmask and ZMM states
+    return ((regs[1] & (1u << 16)) != 0) && ((regs[1] & (1u << 17)) != 0) &&
+           ((regs[1] & (1u << 30)) != 0) && ((xcr0() & 0xe6) == 0xe6);
+  }
+  return false;
+}
+#else
+bool supports(tnzu::kernels::Table const* table) {
+  return table == tnzu::kernels::baseline();
+}
+#endif
+
+// the widest variant the CPU supports, or the one named `name`
+void select_kernels(char const* name) {
+  tnzu::kernels::Table const* const tables[] = {
+      tnzu::kernels::avx512(), tnzu::kernels::avx2(),
+      tnzu::kernels::baseline(),
+  };
+
+  if (name && *name) {
+    for (tnzu::kernels::Table const* table : tables) {
+      if (table && (std::strcmp(table->name, name) == 0)) {
+        if (supports(table)) {
+          row_kernels = table;
+          return;
+        }
+        break;
+      }
+    }
+    TNZU_LOG_WARNING("SIMD variant " << name << " is not available");
+  }
+
+  for (tnzu::kernels::Table const* table : tables) {
+    if (supports(table)) {
+      row_kernels = table;
+      return;
+    }
+  }
+}
+
+void over_row(cv::Vec4b* dst, cv::Vec4b const* src, int width) {
+  row_kernels->over_row8(dst->val, src->val, width);
+}
+
+void over_row(cv::Vec4w* dst, cv::Vec4w const* src, int width) {
+  row_kernels->over_row16(dst->val, src->val, width);
+}
+
 template <typename Vec4T>
 void copy_image(cv::Point src_offset, cv::Mat const& src, cv::Point dst_offset,
                 cv::Mat& dst, cv::Size size, cv::Point2d t) {
-  int const max_value = std::numeric_limits<typename Vec4T::value_type>::max();
-
-  for (int y = 0; y < size.height; ++y) {
-    Vec4T* dst_ptr = dst.ptr<Vec4T>(dst_offset.y + y);
-
-    int const y0 =
-        cv::borderInterpolate(src_offset.y + y + 0, src.rows, cv::BORDER_WRAP);
-    int const y1 =
-        cv::borderInterpolate(src_offset.y + y + 1, src.rows, cv::BORDER_WRAP);
+  if ((t.x == 0.0) && (t.y == 0.0)) {
+    // integer offset, the source is not resampled
+    parallel_bands(size, [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        over_row(dst.ptr<Vec4T>(dst_offset.y + y) + dst_offset.x,
+                 src.ptr<Vec4T>(src_offset.y + y) + src_offset.x, size.width);
+      }
+    });
+    return;
+  }
 
-    for (int x = 0; x < size.width; ++x) {
-      Vec4T d = dst_ptr[dst_offset.x + x];
+  parallel_bands(size, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      Vec4T* dst_ptr = dst.ptr<Vec4T>(dst_offset.y + y);
 
-      int const x0 = cv::borderInterpolate(src_offset.x + x + 0, src.cols,
+      int const y0 = cv::borderInterpolate(src_offset.y + y + 0, src.rows,
                                            cv::BORDER_WRAP);
-      int const x1 = cv::borderInterpolate(src_offset.x + x + 1, src.cols,
+      int const y1 = cv::borderInterpolate(src_offset.y + y + 1, src.rows,
                                            cv::BORDER_WRAP);
 
-      Vec4T const s00 = src.at<Vec4T>(y0, x0);
-      Vec4T const s01 = src.at<Vec4T>(y0, x1);
-      Vec4T const s10 = src.at<Vec4T>(y1, x0);
-      Vec4T const s11 = src.at<Vec4T>(y1, x1);
+      for (int x = 0; x < size.width; ++x) {
+        Vec4T d = dst_ptr[dst_offset.x + x];
 
-      Vec4T const s =
-          tnzu::lerp(tnzu::lerp(s00, s01, t.x), tnzu::lerp(s10, s11, t.x), t.y);
+        int const x0 = cv::borderInterpolate(src_offset.x + x + 0, src.cols,
+                                             cv::BORDER_WRAP);
+        int const x1 = cv::borderInterpolate(src_offset.x + x + 1, src.cols,
+                                             cv::BORDER_WRAP);
 
-      for (int c = 0; c < 4; ++c) {
-        d[c] = d[c] * (max_value - s[3]) / max_value + s[c];
-      }
+        Vec4T const s00 = src.at<Vec4T>(y0, x0);
+        Vec4T const s01 = src.at<Vec4T>(y0, x1);
+        Vec4T const s10 = src.at<Vec4T>(y1, x0);
+        Vec4T const s11 = src.at<Vec4T>(y1, x1);
+
+        Vec4T const s = tnzu::lerp(tnzu::lerp(s00, s01, t.x),
+                                   tnzu::lerp(s10, s11, t.x), t.y);
 
-      dst_ptr[dst_offset.x + x] = d;
+        for (int c = 0; c < 4; ++c) {
+          d[c] = over_channel(d[c], s[c], s[3]);
+        }
+
+        dst_ptr[dst_offset.x + x] = d;
+      }
     }
+  });
+}
+
+// index of the tap `i` of a source of `n` pixels, or -1 for a transparent
+// pixel outside of it
+inline int border_index(int i, int n, tnzu::SampleBorder border) {
+  if ((i >= 0) && (i < n)) {
+    return i;
+  }
+  switch (border) {
+    case tnzu::SAMPLE_BORDER_WRAP:
+      i %= n;
+      return (i < 0) ? i + n : i;
+    case tnzu::SAMPLE_BORDER_CLAMP:
+      return (i < 0) ? 0 : n - 1;
+    default:
+      return -1;
   }
 }
 
-}  //  end of unnamed namespace
+// a coordinate brought into a range where the taps of it do not overflow
+inline float border_coord(float v, int n, tnzu::SampleBorder border) {
+  if (border == tnzu::SAMPLE_BORDER_WRAP) {
+    return v - std::floor(v / n) * n;
+  }
+  // taps are all outside beyond the range
+  return std::min(std::max(v, -3.0f), n + 2.0f);
+}
 
-namespace tnzu {
-Fx::~Fx() {}
+// weights of 4 taps at [-1, 2] for a fraction `t`, as INTER_CUBIC of OpenCV
+inline void cubic_weights(float t, float w[4]) {
+  float const a = -0.75f;
+  w[0] = ((a * (t + 1) - 5 * a) * (t + 1) + 8 * a) * (t + 1) - 4 * a;
+  w[1] = ((a + 2) * t - (a + 3)) * t * t + 1;
+  w[2] = ((a + 2) * (1 - t) - (a + 3)) * (1 - t) * (1 - t) + 1;
+  w[3] = 1.0f - w[0] - w[1] - w[2];
+}
 
-std::string Fx::get_stuff_dir() {
-  static std::string const dir =
-      get_system_var("SOFTWARE\\OpenToonz\\OpenToonz\\1.1", "TOONZROOT");
-  return dir;
+// a pixel in float, accumulated from taps
+#ifdef TNZU_USE_SSE2
+typedef __m128 Texel;
+
+inline Texel zero_texel() { return _mm_setzero_ps(); }
+
+inline Texel load_texel(cv::Vec4b const& p) {
+  std::int32_t v;
+  std::memcpy(&v, p.val, sizeof(v));
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const b = _mm_cvtsi32_si128(v);
+  return _mm_cvtepi32_ps(
+      _mm_unpacklo_epi16(_mm_unpacklo_epi8(b, zero), zero));
 }
 
-int Fx::init() { return 0; }
+inline Texel load_texel(cv::Vec4w const& p) {
+  __m128i const w = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(p.val));
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(w, _mm_setzero_si128()));
+}
 
-int Fx::begin_render() { return 0; }
+inline Texel add_texel(Texel acc, Texel t, float w) {
+  return _mm_add_ps(acc, _mm_mul_ps(t, _mm_set1_ps(w)));
+}
 
-int Fx::end_render() { return 0; }
+// clamps colors to [0, alpha] and alpha to [0, max], which bicubic filtering
+// may overshoot
+inline Texel clamp_texel(Texel t, float max) {
+  t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(max));
+  return _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 3, 3, 3)));
+}
 
-int Fx::begin_frame() { return 0; }
+inline void store_texel(Texel t, cv::Vec4b& p) {
+  __m128i const v = _mm_cvtps_epi32(t);
+  __m128i const w = _mm_packs_epi32(v, v);
+  std::int32_t const b = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+  std::memcpy(p.val, &b, sizeof(b));
+}
 
-int Fx::end_frame() { return 0; }
+inline void store_texel(Texel t, cv::Vec4w& p) {
+  // packs through int16_t, biased as SSE2 has no unsigned packing of int32_t
+  __m128i const v = _mm_sub_epi32(_mm_cvtps_epi32(t), _mm_set1_epi32(0x8000));
+  __m128i const w =
+      _mm_xor_si128(_mm_packs_epi32(v, v), _mm_set1_epi16(-0x8000));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p.val), w);
+}
+#else
+typedef cv::Vec4f Texel;
 
-int Fx::enlarge(Config const& config, Params const& params, cv::Rect2d& retrc) {
-  return 0;
+inline Texel zero_texel() { return Texel(); }
+
+template <typename Vec4T>
+inline Texel load_texel(Vec4T const& p) {
+  return Texel(p[0], p[1], p[2], p[3]);
 }
 
-void draw_image(cv::Mat& dst, cv::Mat const& src, cv::Point2d pos) {
-  if (src.type() != dst.type()) {
-    return;
+inline Texel add_texel(Texel acc, Texel t, float w) { return acc + t * w; }
+
+inline Texel clamp_texel(Texel t, float max) {
+  float const a = std::min(std::max(t[3], 0.0f), max);
+  for (int c = 0; c < 3; ++c) {
+    t[c] = std::min(std::max(t[c], 0.0f), a);
   }
+  t[3] = a;
+  return t;
+}
 
-  if ((src.type() != CV_8UC4) && (src.type() != CV_16UC4)) {
-    return;
+template <typename Vec4T>
+inline void store_texel(Texel t, Vec4T& p) {
+  for (int c = 0; c < 4; ++c) {
+    p[c] = cv::saturate_cast<typename Vec4T::value_type>(t[c]);
   }
+}
+#endif
 
-  cv::Size const dst_size = dst.size();
+// samples `src` at `width` points of `coords` into `dst`
+template <typename Vec4T>
+void sample_row(cv::Mat const& src, cv::Point2f const* coords, int width,
+                Vec4T* dst, tnzu::SampleBorder border,
+                tnzu::SampleFilter filter) {
+  bool const cubic = (filter == tnzu::SAMPLE_FILTER_BICUBIC);
+  int const taps = cubic ? 4 : 2;
+  int const first = cubic ? -1 : 0;
+  float const max = std::numeric_limits<typename Vec4T::value_type>::max();
+
+  for (int i = 0; i < width; ++i) {
+    float const x = border_coord(coords[i].x, src.cols, border);
+    float const y = border_coord(coords[i].y, src.rows, border);
+    if ((x != x) || (y != y)) {
+      dst[i] = Vec4T();
+      continue;
+    }
 
-  cv::Point2d src_offset(0, 0);
-  cv::Size src_size = src.size();
+    float const fx = std::floor(x);
+    float const fy = std::floor(y);
+    int const x0 = static_cast<int>(fx) + first;
+    int const y0 = static_cast<int>(fy) + first;
 
-  cv::Point dst_offset(static_cast<int>(std::floor(pos.x)),
-                       static_cast<int>(std::floor(pos.y)));
+    float wx[4], wy[4];
+    if (cubic) {
+      cubic_weights(x - fx, wx);
+      cubic_weights(y - fy, wy);
+    } else {
+      wx[1] = x - fx;
+      wx[0] = 1.0f - wx[1];
+      wy[1] = y - fy;
+      wy[0] = 1.0f - wy[1];
+    }
 
-  if ((dst_offset.x >= dst_size.width) ||
-      (dst_offset.x + src_size.width <= 0) ||
-      (dst_offset.y >= dst_size.height) ||
-      (dst_offset.y + src_size.height <= 0)) {
+    int cols[4];
+    for (int k = 0; k < taps; ++k) {
+      cols[k] = border_index(x0 + k, src.cols, border);
+    }
+
+    Texel acc = zero_texel();
+    for (int j = 0; j < taps; ++j) {
+      int const row = border_index(y0 + j, src.rows, border);
+      if (row < 0) {
+        continue;
+      }
+      Vec4T const* const p = src.ptr<Vec4T>(row);
+      Texel sum = zero_texel();
+      for (int k = 0; k < taps; ++k) {
+        if (cols[k] >= 0) {
+          sum = add_texel(sum, load_texel(p[cols[k]]), wx[k]);
+        }
+      }
+      acc = add_texel(acc, sum, wy[j]);
+    }
+
+    store_texel(cubic ? clamp_texel(acc, max) : acc, dst[i]);
+  }
+}
+
+// samples `src` at points that `row(y, coords)` fills for each row `y` of
+// `size`, into `dst` of the type of `src`. rows are sampled in parallel.
+void sample_rows(
+    cv::Mat const& src, cv::Size size,
+    std::function<void(int, cv::Point2f*)> const& row, cv::Mat& dst,
+    tnzu::SampleBorder border, tnzu::SampleFilter filter) {
+  CV_Assert((src.type() == CV_8UC4) || (src.type() == CV_16UC4));
+  create_pooled(dst, size, src.type());
+  if (src.empty()) {
+    dst = cv::Scalar::all(0);
     return;
   }
 
-  if (dst_offset.x < 0) {
-    src_offset.x -= dst_offset.x;
-    src_size.width += dst_offset.x;
-    dst_offset.x = 0;
+  parallel_bands(size, [&](int begin, int end) {
+    std::vector<cv::Point2f> coords(size.width);
+    for (int y = begin; y < end; ++y) {
+      row(y, coords.data());
+      if (src.type() == CV_8UC4) {
+        sample_row(src, coords.data(), size.width, dst.ptr<cv::Vec4b>(y),
+                   border, filter);
+      } else {
+        sample_row(src, coords.data(), size.width, dst.ptr<cv::Vec4w>(y),
+                   border, filter);
+      }
+    }
+  });
+}
+
+// hash of a lattice point of gradient noise
+inline std::uint32_t lattice_hash(std::int32_t x, std::int32_t y,
+                                  std::int32_t z, std::uint32_t seed) {
+  std::uint32_t h = seed ^ (std::uint32_t(x) * 0x8da6b343u) ^
+                    (std::uint32_t(y) * 0xd8163841u) ^
+                    (std::uint32_t(z) * 0xcb1ab31fu);
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  h *= 0x297a2d39u;
+  h ^= h >> 15;
+  return h;
+}
+
+// components of a gradient in [-1, 1) taken from bits of a hash
+inline float gradient(std::uint32_t h, std::uint32_t k) {
+  return static_cast<std::int32_t>(h * k) * (1.0f / 2147483648.0f);
+}
+
+inline float dot_gradient(std::uint32_t h, float x, float y) {
+  return gradient(h, 1u) * x + gradient(h, 0x9e3779b9u) * y;
+}
+
+inline float dot_gradient(std::uint32_t h, float x, float y, float z) {
+  return gradient(h, 1u) * x + gradient(h, 0x9e3779b9u) * y +
+         gradient(h, 0x85ebca6bu) * z;
+}
+
+inline float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+
+// floor without a branch, so loops over pixels are vectorized
+inline std::int32_t floor_int(float v) {
+  std::int32_t const i = static_cast<std::int32_t>(v);
+  return i - (v < static_cast<float>(i));
+}
+
+inline float gradient_noise(std::uint32_t seed, float x, float y) {
+  std::int32_t const ix = floor_int(x);
+  std::int32_t const iy = floor_int(y);
+  float const fx = x - ix;
+  float const fy = y - iy;
+
+  float const n00 = dot_gradient(lattice_hash(ix, iy, 0, seed), fx, fy);
+  float const n10 =
+      dot_gradient(lattice_hash(ix + 1, iy, 0, seed), fx - 1, fy);
+  float const n01 =
+      dot_gradient(lattice_hash(ix, iy + 1, 0, seed), fx, fy - 1);
+  float const n11 =
+      dot_gradient(lattice_hash(ix + 1, iy + 1, 0, seed), fx - 1, fy - 1);
+
+  float const wx = fade(fx);
+  float const n0 = n00 + (n10 - n00) * wx;
+  float const n1 = n01 + (n11 - n01) * wx;
+
+  // scales the range of random gradients to about [-1, 1]
+  return (n0 + (n1 - n0) * fade(fy)) * 1.6f;
+}
+
+inline float gradient_noise(std::uint32_t seed, float x, float y, float t) {
+  std::int32_t const ix = floor_int(x);
+  std::int32_t const iy = floor_int(y);
+  std::int32_t const it = floor_int(t);
+  float const fx = x - ix;
+  float const fy = y - iy;
+  float const ft = t - it;
+
+  float const wx = fade(fx);
+  float const wy = fade(fy);
+
+  float n[2];
+  for (int k = 0; k < 2; ++k) {
+    std::int32_t const z = it + k;
+    float const fz = ft - k;
+    float const n00 = dot_gradient(lattice_hash(ix, iy, z, seed), fx, fy, fz);
+    float const n10 =
+        dot_gradient(lattice_hash(ix + 1, iy, z, seed), fx - 1, fy, fz);
+    float const n01 =
+        dot_gradient(lattice_hash(ix, iy + 1, z, seed), fx, fy - 1, fz);
+    float const n11 =
+        dot_gradient(lattice_hash(ix + 1, iy + 1, z, seed), fx - 1, fy - 1, fz);
+    float const n0 = n00 + (n10 - n00) * wx;
+    float const n1 = n01 + (n11 - n01) * wx;
+    n[k] = n0 + (n1 - n0) * wy;
   }
+  return (n[0] + (n[1] - n[0]) * fade(ft)) * 1.25f;
+}
 
-  if (dst_offset.x + src_size.width > dst_size.width) {
-    src_size.width = dst_size.width - dst_offset.x;
+// stream words of the distributions, whose high bits tell them apart so that
+// fields of the same seed are independent. the low bits count groups of four
+// channels.
+std::uint32_t const UNIFORM_STREAM = 0x00000000u;
+std::uint32_t const BERNOULLI_STREAM = 0x40000000u;
+std::uint32_t const NORMAL_STREAM = 0x80000000u;
+
+// writes `f(block, k)` to each channel of `dst`, where `block` is drawn
+// from (x, y, frame, stream | group) for a group of four channels and `k` is
+// the index of the channel in the group
+template <typename T, typename F>
+void fill_random_as(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                    int frame, std::uint32_t stream, F const& f) {
+  tnzu::Philox const rng(seed);
+  double const max = std::numeric_limits<T>::is_integer
+                         ? double(std::numeric_limits<T>::max())
+                         : 1.0;
+  int const cn = dst.channels();
+  std::uint32_t const t = static_cast<std::uint32_t>(frame);
+
+  parallel_bands(dst.size(), [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      T* p = dst.ptr<T>(y);
+      std::uint32_t const v = static_cast<std::uint32_t>(origin.y + y);
+      for (int x = 0; x < dst.cols; ++x, p += cn) {
+        std::uint32_t const u = static_cast<std::uint32_t>(origin.x + x);
+        for (int c = 0; c < cn; c += 4) {
+          tnzu::Philox::result_type const r = rng(u, v, t, stream | (c / 4));
+          for (int k = 0; (k < 4) && (c + k < cn); ++k) {
+            p[c + k] = cv::saturate_cast<T>(f(r, k) * max);
+          }
+        }
+      }
+    }
+  });
+}
+
+template <typename F>
+void fill_random(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                 int frame, std::uint32_t stream, F const& f) {
+  switch (dst.depth()) {
+    case CV_8U:
+      fill_random_as<std::uint8_t>(dst, origin, seed, frame, stream, f);
+      break;
+    case CV_16U:
+      fill_random_as<std::uint16_t>(dst, origin, seed, frame, stream, f);
+      break;
+    case CV_32F:
+      fill_random_as<float>(dst, origin, seed, frame, stream, f);
+      break;
+    default:
+      TNZU_LOG_WARNING("unsupported depth of a random field");
+      break;
+  }
+}
+
+// the index of the worker running on this thread, or -1 for host threads
+thread_local int worker_index = -1;
+
+// work-stealing executor shared by all nodes of the plugin. a worker pops
+// its own tasks from the back of its deque and steals the oldest tasks of
+// the others from the front. tasks submitted by host threads go to a shared
+// queue.
+class Executor {
+ public:
+  // never destroyed: joining threads in a static destructor may deadlock
+  // under the loader lock of Windows, so the threads are joined only by
+  // shutdown() in toonz_plugin_exit_main.
+  static Executor& instance() {
+    static Executor* const executor = new Executor;
+    return *executor;
+  }
+
+  int size() {
+    start();
+    return static_cast<int>(threads_.size());
+  }
+
+  int budget() const { return budget_; }
+
+  void set_budget(int threads) {
+    budget_ = (threads > 0) ? threads : hardware_threads();
+  }
+
+  // threads a loop may use, callers included. the budget is divided among
+  // host threads computing tiles at once, since each of them runs its own
+  // loops.
+  int share() {
+    int const computes = std::max(1, computes_.load());
+    return std::max(1, std::min(budget_ / computes, size() + 1));
+  }
+
+  void enter_compute() { ++computes_; }
+
+  void leave_compute() { --computes_; }
+
+  void submit(std::function<void()> task) {
+    start();
+    Queue& queue = (worker_index >= 0) ? *queues_[worker_index] : shared_;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++pending_;
+    }
+    cond_.notify_one();
+  }
+
+  tnzu::ExecutorStats stats() {
+    tnzu::ExecutorStats const stats = {size(), budget_.load(),
+                                       computes_.load(), tasks_.load(),
+                                       steals_.load()};
+    return stats;
+  }
+
+  // joins the threads, must be called before the plugin is unloaded.
+  // queued tasks are run before the workers exit. the executor is reset,
+  // and threads are started again by the next submit() after a re-init.
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    for (std::thread& t : threads_) {
+      t.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.clear();
+    queues_.clear();
+    shared_.tasks.clear();
+    pending_ = 0;
+    started_ = false;
+    stop_ = false;
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  Executor()
+      : budget_(hardware_threads()),
+        computes_(0),
+        tasks_(0),
+        steals_(0),
+        pending_(0),
+        started_(false),
+        stop_(false) {}
+
+  static int hardware_threads() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
   }
 
-  if (dst_offset.y < 0) {
-    src_offset.y -= dst_offset.y;
-    src_size.height += dst_offset.y;
-    dst_offset.y = 0;
+  void start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_) {
+      return;
+    }
+    started_ = true;
+    // the calling thread takes part in loops
+    int const n = std::max(1, hardware_threads() - 1);
+    for (int i = 0; i < n; i++) {
+      queues_.emplace_back(new Queue);
+    }
+    for (int i = 0; i < n; i++) {
+      threads_.emplace_back(&Executor::run, this, i);
+    }
+  }
+
+  static bool pop_back(Queue& queue, std::function<void()>& task) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+  }
+
+  static bool pop_front(Queue& queue, std::function<void()>& task) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  bool take(int i, std::function<void()>& task) {
+    if (pop_back(*queues_[i], task) || pop_front(shared_, task)) {
+      return true;
+    }
+    int const n = static_cast<int>(queues_.size());
+    for (int j = 1; j < n; j++) {
+      if (pop_front(*queues_[(i + j) % n], task)) {
+        ++steals_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(int i) {
+    worker_index = i;
+    for (;;) {
+      std::function<void()> task;
+      if (take(i, task)) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          --pending_;
+        }
+        ++tasks_;
+        task();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stop_) {
+        return;
+      }
+      cond_.wait(lock, [this] { return stop_ || (pending_ > 0); });
+    }
+  }
+
+ private:
+  std::atomic<int> budget_;
+  std::atomic<int> computes_;
+  std::atomic<std::uint64_t> tasks_;
+  std::atomic<std::uint64_t> steals_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  Queue shared_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  int pending_;  // queued tasks, guarded by `mutex_`
+  bool started_;
+  bool stop_;
+};
+
+// counts do_compute calls of host threads. nested calls, e.g. upstream nodes
+// of this plugin rendered while fetching inputs, and calls on the workers
+// share the budget of the outermost call, which is waiting for them.
+thread_local int compute_depth = 0;
+
+class ComputeScope {
+ public:
+  ComputeScope() : counted_((compute_depth++ == 0) && (worker_index < 0)) {
+    if (counted_) {
+      Executor::instance().enter_compute();
+    }
+  }
+
+  ~ComputeScope() {
+    --compute_depth;
+    if (counted_) {
+      Executor::instance().leave_compute();
+    }
+  }
+
+ private:
+  ComputeScope(ComputeScope const&) = delete;
+  ComputeScope& operator=(ComputeScope const&) = delete;
+
+  bool const counted_;
+};
+
+// indices of a parallel_for call shared by the caller and its helpers.
+// helpers which start after all indices are taken never touch `f`.
+struct ParallelLoop {
+  inline ParallelLoop(int n, std::function<void(int)> const& f)
+      : n(n), f(&f), next(0), remaining(n) {}
+
+  void run() {
+    for (;;) {
+      int const i = next++;
+      if (i >= n) {
+        return;
+      }
+
+      try {
+        (*f)(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+
+      if (--remaining == 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.notify_all();
+      }
+    }
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return remaining == 0; });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  int const n;
+  std::function<void(int)> const* const f;
+  std::atomic<int> next;
+  std::atomic<int> remaining;
+  std::mutex mutex;
+  std::condition_variable done;
+  std::exception_ptr error;
+};
+
+// the run-time log level
+std::atomic<int> log_level_value(TNZU_LOG_LEVEL);
+
+char const* const log_level_names[] = {"", "ERROR", "WARNING", "INFO",
+                                       "DEBUG"};
+
+// spans recorded by a thread. only the owner writes events, and publishes
+// each of them by `head`, so a reader sees complete events.
+struct TraceRing {
+  struct Event {
+    char const* name;
+    std::int64_t begin;
+    std::int64_t end;
+  };
+
+  static std::size_t const capacity = 1 << 14;
+
+  explicit TraceRing(int tid) : tid(tid), head(0), events(capacity) {}
+
+  void push(char const* name, std::int64_t begin, std::int64_t end) {
+    std::uint64_t const h = head.load(std::memory_order_relaxed);
+    Event& e = events[h & (capacity - 1)];
+    e.name = name;
+    e.begin = begin;
+    e.end = end;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  int const tid;
+  std::atomic<std::uint64_t> head;
+  std::vector<Event> events;
+};
+
+class Tracer {
+ public:
+  static Tracer& instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // nanoseconds since the tracer was created
+  std::int64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch_)
+        .count();
+  }
+
+  // the ring of the calling thread, registered on first use
+  TraceRing& ring() {
+    thread_local std::shared_ptr<TraceRing> ring;
+    if (!ring) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ring = std::make_shared<TraceRing>(static_cast<int>(rings_.size()) + 1);
+      rings_.push_back(ring);
+    }
+    return *ring;
+  }
+
+  void start(std::string const& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    enabled_ = true;
+  }
+
+  // stops recording, and returns the file to write
+  std::string stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = false;
+    return path_;
+  }
+
+  bool write(std::string const& path) {
+    std::FILE* fp = std::fopen(path.c_str(), "w");
+    if (!fp) {
+      return false;
+    }
+
+    std::fputs("{\"traceEvents\":[", fp);
+    bool first = true;
+    std::uint64_t dropped = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::shared_ptr<TraceRing> const& ring : rings_) {
+      std::uint64_t const head = ring->head.load(std::memory_order_acquire);
+      std::uint64_t const n =
+          std::min(head, static_cast<std::uint64_t>(TraceRing::capacity));
+      dropped += head - n;
+      for (std::uint64_t i = head - n; i < head; i++) {
+        TraceRing::Event const& e = ring->events[i & (TraceRing::capacity - 1)];
+        std::fprintf(fp,
+                     "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                     "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     first ? "" : ",", e.name, ring->tid, e.begin * 1e-3,
+                     (e.end - e.begin) * 1e-3);
+        first = false;
+      }
+    }
+    // spans overwritten in full rings, so that readers can tell partial sums
+    std::fprintf(fp,
+                 "\n],\n\"otherData\":{\"dropped_spans\":%llu},\n"
+                 "\"displayTimeUnit\":\"ms\"}\n",
+                 static_cast<unsigned long long>(dropped));
+    if (dropped) {
+      TNZU_LOG_WARNING(dropped << " trace spans were overwritten");
+    }
+    return std::fclose(fp) == 0;
+  }
+
+ private:
+  Tracer() : enabled_(false), epoch_(std::chrono::steady_clock::now()) {}
+
+  std::atomic<bool> enabled_;
+  std::chrono::steady_clock::time_point const epoch_;
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<TraceRing>> rings_;
+  std::string path_;
+};
+
+}  //  end of unnamed namespace
+
+namespace tnzu {
+std::string Fx::get_stuff_dir() {
+  static std::string const dir =
+      get_system_var("SOFTWARE\\OpenToonz\\OpenToonz\\1.1", "TOONZROOT");
+  return dir;
+}
+
+int Fx::init() { return 0; }
+
+int Fx::begin_render() { return 0; }
+
+int Fx::end_render() { return 0; }
+
+int Fx::begin_frame() { return 0; }
+
+int Fx::end_frame() { return 0; }
+
+int Fx::enlarge(Config const& config, Params const& params, cv::Rect2d& retrc) {
+  return 0;
+}
+
+int Fx::require(Config const& config, Params const& params, cv::Rect2d& retrc) {
+  retrc = tnzu::make_infinite_rect<double>();
+  return 0;
+}
+
+std::size_t Fx::memory_requirement(Config const& config, Params const& params,
+                                   cv::Rect2d const& rect) {
+  if (!std::isfinite(rect.width) || !std::isfinite(rect.height) ||
+      (rect.width <= 0) || (rect.height <= 0)) {
+    return 0;
+  }
+
+  std::size_t const native = (config.bpp > 0) ? config.bpp / 8 : 4;
+
+  // inputs, a result and scratch buffers
+  std::size_t pixel_size = pixel_bytes(output_format(), native) *
+                           (1 + scratch_buffer_count());
+  for (int i = 0, portc = port_count(); i < portc; i++) {
+    pixel_size += pixel_bytes(port_format(i), native);
+  }
+
+  return static_cast<std::size_t>(std::ceil(rect.width) *
+                                  std::ceil(rect.height)) *
+         pixel_size;
+}
+
+Fx::PixelFormat Fx::port_format(int i) const { return PIXEL_FORMAT_NATIVE; }
+
+Fx::PixelFormat Fx::output_format() const { return PIXEL_FORMAT_NATIVE; }
+
+int Fx::scratch_buffer_count() const { return 0; }
+
+bool Fx::use_subtiles() const { return false; }
+
+int Fx::input_concurrency() const { return 0; }
+
+std::size_t Fx::cache_budget() const { return 0; }
+
+double Fx::proxy_scale(Config const& config) const { return 1.0; }
+
+bool Fx::param_spatial(int i) const { return false; }
+
+std::size_t Fx::persistent_budget() const { return std::size_t(256) << 20; }
+
+void parallel_for(int n, int concurrency, std::function<void(int)> const& f) {
+  if (n <= 0) {
+    return;
+  }
+
+  Executor& executor = Executor::instance();
+  int const k = std::min(n, (concurrency > 0)
+                                ? std::min(concurrency, executor.size() + 1)
+                                : executor.share());
+  if (k <= 1) {
+    for (int i = 0; i < n; i++) {
+      f(i);
+    }
+    return;
+  }
+
+  std::shared_ptr<ParallelLoop> const loop =
+      std::make_shared<ParallelLoop>(n, f);
+  for (int j = 1; j < k; j++) {
+    executor.submit([loop] { loop->run(); });
+  }
+  loop->run();
+  loop->wait();
+}
+
+void set_concurrency_budget(int threads) {
+  Executor::instance().set_budget(threads);
+}
+
+ExecutorStats executor_stats() { return Executor::instance().stats(); }
+
+char const* simd_variant() { return row_kernels->name; }
+
+namespace kernels {
+Table const* selected() { return row_kernels; }
+}
+
+cv::MatAllocator* buffer_allocator() { return &BufferPool::instance(); }
+
+void set_buffer_pool_limit(std::size_t bytes) {
+  BufferPool::instance().set_limit(bytes);
+}
+
+void set_huge_pages(bool enable) {
+  BufferPool::instance().set_huge_pages(enable);
+}
+
+BufferPoolStats buffer_pool_stats() { return BufferPool::instance().stats(); }
+
+void sample_image(cv::Mat const& src, cv::Mat const& coords, cv::Mat& dst,
+                  SampleBorder border, SampleFilter filter) {
+  CV_Assert(coords.type() == CV_32FC2);
+  sample_rows(src, coords.size(),
+              [&](int y, cv::Point2f* row) {
+                std::memcpy(row, coords.ptr<cv::Point2f>(y),
+                            coords.cols * sizeof(cv::Point2f));
+              },
+              dst, border, filter);
+}
+
+void sample_image(cv::Mat const& src, cv::Matx23d const& m, cv::Size size,
+                  cv::Mat& dst, SampleBorder border, SampleFilter filter) {
+  sample_rows(src, size,
+              [&](int y, cv::Point2f* row) {
+                for (int x = 0; x < size.width; ++x) {
+                  row[x].x = static_cast<float>(m(0, 0) * x + m(0, 1) * y +
+                                                m(0, 2));
+                  row[x].y = static_cast<float>(m(1, 0) * x + m(1, 1) * y +
+                                                m(1, 2));
+                }
+              },
+              dst, border, filter);
+}
+
+void sample_image(cv::Mat const& src, cv::Size size,
+                  std::function<void(int, cv::Point2f*)> const& row,
+                  cv::Mat& dst, SampleBorder border, SampleFilter filter) {
+  sample_rows(src, size, row, dst, border, filter);
+}
+
+void draw_image(cv::Mat& dst, cv::Mat const& src, cv::Point2d pos) {
+  if (src.type() != dst.type()) {
+    return;
+  }
+
+  if ((src.type() != CV_8UC4) && (src.type() != CV_16UC4)) {
+    return;
+  }
+
+  cv::Size const dst_size = dst.size();
+
+  cv::Point2d src_offset(0, 0);
+  cv::Size src_size = src.size();
+
+  cv::Point dst_offset(static_cast<int>(std::floor(pos.x)),
+                       static_cast<int>(std::floor(pos.y)));
+
+  if ((dst_offset.x >= dst_size.width) ||
+      (dst_offset.x + src_size.width <= 0) ||
+      (dst_offset.y >= dst_size.height) ||
+      (dst_offset.y + src_size.height <= 0)) {
+    return;
+  }
+
+  if (dst_offset.x < 0) {
+    src_offset.x -= dst_offset.x;
+    src_size.width += dst_offset.x;
+    dst_offset.x = 0;
+  }
+
+  if (dst_offset.x + src_size.width > dst_size.width) {
+    src_size.width = dst_size.width - dst_offset.x;
+  }
+
+  if (dst_offset.y < 0) {
+    src_offset.y -= dst_offset.y;
+    src_size.height += dst_offset.y;
+    dst_offset.y = 0;
+  }
+
+  if (dst_offset.y + src_size.height > dst_size.height) {
+    src_size.height = dst_size.height - dst_offset.y;
+  }
+
+  if ((src_size.width <= 0) || (src_size.height <= 0)) {
+    return;
+  }
+
+  cv::Point2d t(src_offset.x - std::floor(src_offset.x),
+                src_offset.y - std::floor(src_offset.y));
+
+  if (src.type() == CV_8UC4) {
+    copy_image<cv::Vec4b>(src_offset, src, dst_offset, dst, src_size, t);
+  } else {
+    copy_image<cv::Vec4w>(src_offset, src, dst_offset, dst, src_size, t);
+  }
+}
+
+void Bloom::apply(cv::Mat const& src, cv::Mat& dst, int level, int radius,
+                  float threshold, float knee, cv::Rect roi) {
+  if (src.empty()) {
+    dst.release();
+    return;
+  }
+
+  cv::Rect const whole(cv::Point(0, 0), src.size());
+  roi = (roi.area() > 0) ? (roi & whole) : whole;
+  if (roi.area() <= 0) {
+    dst.release();
+    return;
+  }
+
+  // sizes of levels, halved until either side reaches 1
+  sizes_.assign(1, src.size());
+  for (int i = 1; i <= level; ++i) {
+    cv::Size const size = sizes_.back();
+    if ((size.width <= 1) || (size.height <= 1)) {
+      break;
+    }
+    sizes_.push_back(size / 2);
+  }
+
+  int const n = static_cast<int>(sizes_.size());
+  int const cn = src.channels();
+  int const type = CV_MAKETYPE(CV_32F, cn);
+  double const max = (src.depth() == CV_8U)
+                         ? std::numeric_limits<std::uint8_t>::max()
+                         : (src.depth() == CV_16U)
+                               ? std::numeric_limits<std::uint16_t>::max()
+                               : 1.0;
+
+  levels_.resize(n);
+  blurred_.resize(n);
+  for (int i = 0; i < n; ++i) {
+    create_pooled(levels_[i], sizes_[i], type);
+    create_pooled(blurred_[i], sizes_[i], type);
+  }
+
+  // normalizes the source and applies the bright pass
+  bool const bright_pass = (threshold > 0.0f) || (knee > 0.0f);
+  parallel_bands(src.size(), [&](int begin, int end) {
+    cv::Mat band = levels_[0].rowRange(begin, end);
+    src.rowRange(begin, end).convertTo(band, type, 1.0 / max);
+    if (!bright_pass) {
+      return;
+    }
+
+    int const colors = std::min(cn, 3);
+    for (int y = 0; y < band.rows; ++y) {
+      float* p = band.ptr<float>(y);
+      for (int x = 0; x < band.cols; ++x, p += cn) {
+        float b = 0.0f;
+        for (int c = 0; c < colors; ++c) {
+          b = std::max(b, p[c]);
+        }
+
+        // quadratic curve over [threshold - knee, threshold + knee]
+        float soft = std::min(std::max(b - threshold + knee, 0.0f), 2 * knee);
+        soft = soft * soft / (4 * knee + 1e-5f);
+
+        float const w = std::max(soft, b - threshold) / std::max(b, 1e-5f);
+        for (int c = 0; c < cn; ++c) {
+          p[c] *= w;
+        }
+      }
+    }
+  });
+
+  for (int i = 1; i < n; ++i) {
+    cv::resize(levels_[i - 1], levels_[i], sizes_[i], 0.0, 0.0,
+               cv::INTER_AREA);
+  }
+
+  // blurs bands of all levels at once. bands are views, so the filter reads
+  // neighbors across bands. the finest level is needed only in `roi`.
+  std::vector<std::pair<int, cv::Rect>> bands;
+  for (int i = 0; i < n; ++i) {
+    cv::Rect const area = (i == 0) ? roi : cv::Rect(cv::Point(0, 0), sizes_[i]);
+    int const rows = std::max(1, band_pixels / std::max(1, area.width));
+    for (int y = 0; y < area.height; y += rows) {
+      bands.push_back(std::make_pair(
+          i, cv::Rect(area.x, area.y + y, area.width,
+                      std::min(rows, area.height - y))));
+    }
+  }
+
+  cv::Size const ksize(radius * 2 + 1, radius * 2 + 1);
+  tnzu::parallel_for(static_cast<int>(bands.size()), 0, [&](int k) {
+    int const i = bands[k].first;
+    cv::Rect const& r = bands[k].second;
+    cv::Mat band = blurred_[i](r);
+    cv::GaussianBlur(levels_[i](r), band, ksize, 0.0);
+  });
+
+  // adds coarser levels to finer ones
+  for (int i = n - 1; i > 1; --i) {
+    create_pooled(upsampled_, sizes_[i - 1], type);
+    cv::resize(blurred_[i], upsampled_, sizes_[i - 1]);
+    blurred_[i - 1] += upsampled_;
+  }
+
+  // the finest level in full resolution, in bands
+  cv::Mat result = blurred_[0](roi);
+  double const sx = (n > 1) ? double(sizes_[1].width) / sizes_[0].width : 0;
+  double const sy = (n > 1) ? double(sizes_[1].height) / sizes_[0].height : 0;
+  create_pooled(dst, roi.size(), src.type());
+  if (n > 1) {
+    // bands upsample into their rows of the engine's buffer
+    create_pooled(upsampled_, roi.size(), type);
+  }
+  parallel_bands(roi.size(), [&](int begin, int end) {
+    cv::Mat sum = result.rowRange(begin, end);
+    if (n > 1) {
+      // upsamples only the band of `roi` as cv::resize would do
+      cv::Matx23d const m(sx, 0.0, (roi.x + 0.5) * sx - 0.5, 0.0, sy,
+                          (roi.y + begin + 0.5) * sy - 0.5);
+      cv::Mat upsampled = upsampled_.rowRange(begin, end);
+      cv::warpAffine(blurred_[1], upsampled, m, sum.size(),
+                     cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+                     cv::BORDER_REPLICATE);
+      sum += upsampled;
+    }
+    cv::Mat band = dst.rowRange(begin, end);
+    sum.convertTo(band, src.type(), max);
+  });
+}
+
+cv::Rect Bloom::require(cv::Rect const& roi, int level, int radius) {
+  // keeps the grid within int
+  int const grid = 1 << std::min(std::max(level, 0), 24);
+
+  // blurs, downsampling and upsampling of the coarsest level
+  int const margin = (std::max(radius, 0) + 2) * grid;
+
+  int const x0 = static_cast<int>(
+      std::floor(double(roi.x - margin) / grid) * grid);
+  int const y0 = static_cast<int>(
+      std::floor(double(roi.y - margin) / grid) * grid);
+  int const x1 = static_cast<int>(
+      std::ceil(double(roi.x + roi.width + margin) / grid) * grid);
+  int const y1 = static_cast<int>(
+      std::ceil(double(roi.y + roi.height + margin) / grid) * grid);
+
+  return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+void Bloom::release() {
+  sizes_.clear();
+  levels_.clear();
+  blurred_.clear();
+  upsampled_.release();
+}
+
+void generate_bloom(cv::Mat& img, int level, int radius) {
+  Bloom bloom;
+  cv::Mat dst;
+  bloom.apply(img, dst, level, radius);
+  img = dst;
+}
+
+void for_each_band(cv::Size size, std::uint64_t seed,
+                   std::function<void(Band&)> const& f) {
+  int const rows = std::max(1, band_pixels / std::max(1, size.width));
+  tnzu::parallel_for((size.height + rows - 1) / rows, 0, [&](int k) {
+    Band band(k, k * rows, std::min(size.height, (k + 1) * rows), seed);
+    f(band);
+  });
+}
+
+void fill_uniform(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                  int frame, double low, double high) {
+  fill_random(dst, origin, seed, frame, UNIFORM_STREAM,
+              [&](Philox::result_type const& r, int k) {
+                return low + (high - low) * Philox::to_unit(r[k]);
+              });
+}
+
+void fill_bernoulli(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                    int frame, double p) {
+  fill_random(dst, origin, seed, frame, BERNOULLI_STREAM,
+              [&](Philox::result_type const& r, int k) {
+                return (Philox::to_unit(r[k]) < p) ? 1.0 : 0.0;
+              });
+}
+
+void fill_normal(cv::Mat& dst, cv::Point origin, std::uint64_t seed,
+                 int frame, double mean, double stddev) {
+  // Box-Muller transform of pairs of words, cosine for even channels and
+  // sine for odd ones
+  fill_random(dst, origin, seed, frame, NORMAL_STREAM,
+              [&](Philox::result_type const& r, int k) {
+                float const u1 = ((r[k & 2] >> 8) + 1) * (1.0f / 16777216.0f);
+                float const u2 = Philox::to_unit(r[k | 1]);
+                float const radius = std::sqrt(-2.0f * std::log(u1));
+                float const theta = float(2 * M_PI) * u2;
+                return mean + stddev * radius *
+                                  ((k & 1) ? std::sin(theta) : std::cos(theta));
+              });
+}
+
+GradientNoise::GradientNoise(std::uint64_t seed)
+    : seed_(static_cast<std::uint32_t>(seed) ^
+            static_cast<std::uint32_t>(seed >> 32)) {}
+
+float GradientNoise::operator()(float x, float y) const {
+  return gradient_noise(seed_, x, y);
+}
+
+float GradientNoise::operator()(float x, float y, float t) const {
+  return gradient_noise(seed_, x, y, t);
+}
+
+void GradientNoise::render(cv::Mat& dst, int channels, cv::Size size,
+                           cv::Rect roi, float const* amp, int octaves) const {
+  render(dst, channels, size, roi, amp, octaves, false, 0.0);
+}
+
+void GradientNoise::render(cv::Mat& dst, int channels, cv::Size size,
+                           cv::Rect roi, float const* amp, int octaves,
+                           double time) const {
+  render(dst, channels, size, roi, amp, octaves, true, time);
+}
+
+void GradientNoise::render(cv::Mat& dst, int channels, cv::Size size,
+                           cv::Rect roi, float const* amp, int octaves,
+                           bool animated, double time) const {
+  create_pooled(dst, roi.size(), CV_MAKETYPE(CV_32F, channels));
+  dst = cv::Scalar::all(0);
+
+  double const side = std::max(std::max(size.width, size.height), 1);
+
+  parallel_bands(roi.size(), [&](int begin, int end) {
+    for (int i = 0; i < octaves; ++i) {
+      // pixels to lattice cells
+      float const scale = static_cast<float>((2 << i) / side);
+      float const t = static_cast<float>(time * (1 << i));
+      float const a = amp[i];
+
+      for (int c = 0; c < channels; ++c) {
+        std::uint32_t const seed =
+            lattice_hash(i, c, 0, seed_ ^ 0x5bd1e995u);
+        for (int y = begin; y < end; ++y) {
+          // from canvas coordinates, so that every region rounds alike
+          float* p = dst.ptr<float>(y) + c;
+          float const v = (roi.y + y + 0.5f) * scale;
+          if (animated) {
+            for (int x = 0; x < roi.width; ++x) {
+              float const u = (roi.x + x + 0.5f) * scale;
+              p[x * channels] += a * gradient_noise(seed, u, v, t);
+            }
+          } else {
+            for (int x = 0; x < roi.width; ++x) {
+              float const u = (roi.x + x + 0.5f) * scale;
+              p[x * channels] += a * gradient_noise(seed, u, v);
+            }
+          }
+        }
+      }
+    }
+  });
+}
+}
+
+//
+// tnzu
+//
+namespace {
+std::atomic<std::uint64_t> copied_bytes(0);
+std::atomic<std::uint64_t> aliased_bytes(0);
+
+// locks the raw memory of a tile while alive
+class TileLock {
+ public:
+  explicit TileLock(toonz::tile_handle_t tile)
+      : tile_(tile), data_(nullptr), stride_(0) {
+    tileif->get_rectangle(tile_, &rect_);
+    tileif->get_raw_stride(tile_, &stride_);
+    tileif->get_raw_address_unsafe(tile_, &data_);
+  }
+
+  // a tile of the library at `rect` in memory of `mat`
+  TileLock(cv::Mat& mat, toonz::rect_t const& rect)
+      : tile_(nullptr),
+        data_(mat.data),
+        stride_(static_cast<int>(mat.step[0])),
+        rect_(rect) {}
+
+  ~TileLock() {
+    if (tile_) {
+      tileif->safen(tile_);
+    }
+  }
+
+  TileLock(TileLock const&) = delete;
+  TileLock& operator=(TileLock const&) = delete;
+
+ public:
+  inline std::uint8_t* data() const {
+    return static_cast<std::uint8_t*>(data_);
+  }
+  inline int stride() const { return stride_; }
+  inline toonz::rect_t const& rect() const { return rect_; }
+  inline cv::Size size() const {
+    return cv::Size(static_cast<int>(rect_.x1 - rect_.x0),
+                    static_cast<int>(rect_.y1 - rect_.y0));
+  }
+
+ private:
+  toonz::tile_handle_t tile_;
+  void* data_;
+  int stride_;
+  toonz::rect_t rect_;
+};
+
+// a tile computed by an upstream node. it lives until the end of do_compute,
+// because cv::Mat headers given to Fx::compute may alias its memory.
+struct InputTile {
+  inline InputTile() : handle(nullptr) { tileif->create(&handle); }
+  inline ~InputTile() {
+    lock.reset();
+    if (handle) {
+      tileif->destroy(handle);
+    }
+  }
+
+  InputTile(InputTile const&) = delete;
+  InputTile& operator=(InputTile const&) = delete;
+
+  toonz::tile_handle_t handle;
+  std::unique_ptr<TileLock> lock;
+};
+
+std::atomic<std::uint64_t> cache_hits(0);
+std::atomic<std::uint64_t> cache_misses(0);
+
+// everything a result depends on, as a sequence of words
+class CacheKey {
+ public:
+  inline void push(std::uint64_t word) { words_.push_back(word); }
+
+  inline void push(double value) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, &value, sizeof(word));
+    words_.push_back(word);
+  }
+
+  inline bool operator==(CacheKey const& rhs) const {
+    return words_ == rhs.words_;
+  }
+
+  struct Hash {
+    inline std::size_t operator()(CacheKey const& key) const {
+      std::uint64_t h = 14695981039346656037LLU;
+      for (std::uint64_t const word : key.words_) {
+        h = (h ^ word) * 1099511628211LLU;
+      }
+      return static_cast<std::size_t>(h);
+    }
+  };
+
+ private:
+  std::vector<std::uint64_t> words_;
+};
+
+// least recently used results of a node
+class ResultCache {
+ public:
+  ResultCache() : bytes_(0) {}
+
+  bool find(CacheKey const& key, cv::Mat& mat) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    mat = it->second->second;
+    return true;
+  }
+
+  void insert(CacheKey const& key, cv::Mat const& mat, std::size_t budget) {
+    std::size_t const size = mat.total() * mat.elemSize();
+    if (size > budget) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(key)) {
+      return;
+    }
+
+    while (!lru_.empty() && (bytes_ + size > budget)) {
+      cv::Mat const& last = lru_.back().second;
+      bytes_ -= last.total() * last.elemSize();
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+
+    lru_.push_front(std::make_pair(key, mat));
+    index_[key] = lru_.begin();
+    bytes_ += size;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+  }
+
+ private:
+  typedef std::list<std::pair<CacheKey, cv::Mat>> List;
+
+  std::mutex mutex_;
+  List lru_;
+  std::unordered_map<CacheKey, List::iterator, CacheKey::Hash> index_;
+  std::size_t bytes_;
+};
+
+// objects of a node kept across frames by Fx::persistent(). an object is
+// made again when values of parameters it depends on change, and the least
+// recently used ones are dropped beyond a budget. holders keep dropped
+// objects alive.
+class PersistentStore {
+ public:
+  typedef std::shared_ptr<void const> Object;
+  typedef std::function<Object(std::size_t&)> Make;
+
+  PersistentStore() : bytes_(0), clock_(0) {}
+
+  Object get(std::string const& key, std::type_index type,
+             std::vector<double> const& values, Make const& make,
+             std::size_t budget) {
+    std::shared_ptr<Entry> entry;
+    bool made = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::shared_ptr<Entry>& e = entries_[key];
+      if (!e || (e->type != type) || (e->values != values)) {
+        if (e) {
+          bytes_ -= e->bytes;
+        }
+        e = std::make_shared<Entry>(type, values);
+        made = true;
+      }
+      e->used = ++clock_;
+      entry = e;
+    }
+
+    if (!made) {
+      // waits for another thread making it
+      return entry->object.get();
+    }
+
+    std::size_t bytes = 0;
+    Object object;
+    try {
+      object = make(bytes);
+    } catch (...) {
+      entry->promise.set_exception(std::current_exception());
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto const it = entries_.find(key);
+      if ((it != entries_.end()) && (it->second == entry)) {
+        entries_.erase(it);
+      }
+      throw;
+    }
+    entry->promise.set_value(object);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = entries_.find(key);
+    if ((it == entries_.end()) || (it->second != entry)) {
+      // replaced or cleared while it was made
+      return object;
+    }
+    if (bytes > budget) {
+      entries_.erase(it);
+      return object;
+    }
+    entry->bytes = bytes;
+    bytes_ += bytes;
+    evict(budget);
+    return object;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    bytes_ = 0;
+  }
+
+ private:
+  struct Entry {
+    Entry(std::type_index type, std::vector<double> const& values)
+        : type(type),
+          values(values),
+          object(promise.get_future().share()),
+          bytes(0),
+          used(0) {}
+
+    std::type_index type;
+    std::vector<double> values;
+    std::promise<Object> promise;
+    std::shared_future<Object> object;
+    std::size_t bytes;
+    std::uint64_t used;
+  };
+
+  // objects being made have no bytes, and are kept
+  void evict(std::size_t budget) {
+    while (bytes_ > budget) {
+      auto lru = entries_.end();
+      for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->second->bytes && ((lru == entries_.end()) ||
+                                  (it->second->used < lru->second->used))) {
+          lru = it;
+        }
+      }
+      if (lru == entries_.end()) {
+        break;
+      }
+      bytes_ -= lru->second->bytes;
+      entries_.erase(lru);
+    }
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Entry>> entries_;
+  std::size_t bytes_;
+  std::uint64_t clock_;
+};
+
+// an input port connected to an upstream node
+struct Port {
+  int index;
+  toonz::fxnode_handle_t fxnode;
+  toonz::rect_t bbox;
+};
+
+// bboxes of upstream nodes and the enlarged union of them
+struct Upstream {
+  std::vector<Port> ports;
+  cv::Rect2d rect;
+};
+
+// parameter handles of nodes resolved once, and parameter values and
+// upstream bboxes shared by a bbox query and tiles while a frame is being
+// rendered
+class FrameCache {
+ public:
+  bool resolve(toonz::node_handle_t node, tnzu::Fx const* fx) {
+    std::shared_ptr<std::vector<toonz::param_handle_t>> const handles =
+        std::make_shared<std::vector<toonz::param_handle_t>>(
+            fx->param_count());
+    for (int i = 0, paramc = fx->param_count(); i < paramc; i++) {
+      if (nodeif->get_param(node, fx->param_prototype(i)->name,
+                            &(*handles)[i])) {
+        return false;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_[node].handles = handles;
+    return true;
+  }
+
+  void forget(toonz::node_handle_t node) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_.erase(node);
+  }
+
+  bool get(toonz::node_handle_t node, tnzu::Fx const* fx, double frame,
+           tnzu::Fx::Params& params) {
+    int const paramc = fx->param_count();
+
+    // the handles are shared under the lock rather than copied per lookup
+    Handles handles;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto const it = nodes_.find(node);
+      if (it != nodes_.end()) {
+        auto const jt = it->second.frames.find(frame);
+        if ((jt != it->second.frames.end()) && jt->second.valid) {
+          for (int i = 0; i < paramc; i++) {
+            params[i] = jt->second.values[i];
+          }
+          return true;
+        }
+        handles = it->second.handles;
+      }
+    }
+
+    if (!handles && paramc) {
+      if (!resolve(node, fx)) {
+        return false;
+      }
+      return get(node, fx, frame, params);
+    }
+
+    std::vector<double> values(paramc);
+    for (int i = 0; i < paramc; i++) {
+      int size_in_elements = 1;
+      paramif->get_value((*handles)[i], frame, &size_in_elements,
+                         &values[i]);
+      params[i] = values[i];
+    }
+
+    // values are kept only inside of on_new_frame and on_end_frame
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = nodes_.find(node);
+    if (it != nodes_.end()) {
+      auto const jt = it->second.frames.find(frame);
+      if (jt != it->second.frames.end()) {
+        jt->second.values.swap(values);
+        jt->second.valid = true;
+      }
+    }
+    return true;
+  }
+
+  void begin_frame(toonz::node_handle_t node, double frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_[node].frames[frame].refs++;
+  }
+
+  void end_frame(toonz::node_handle_t node, double frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = nodes_.find(node);
+    if (it == nodes_.end()) {
+      return;
+    }
+    auto const jt = it->second.frames.find(frame);
+    if ((jt != it->second.frames.end()) && (--jt->second.refs <= 0)) {
+      it->second.frames.erase(jt);
+    }
+  }
+
+  bool find_upstream(toonz::node_handle_t node, double frame,
+                     CacheKey const& key, Upstream& upstream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Frame const* const f = find_frame(node, frame);
+    if (!f) {
+      return false;
+    }
+    auto const it = f->upstreams.find(key);
+    if (it == f->upstreams.end()) {
+      return false;
+    }
+    upstream = it->second;
+    return true;
+  }
+
+  void store_upstream(toonz::node_handle_t node, double frame,
+                      CacheKey const& key, Upstream const& upstream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Frame* const f = find_frame(node, frame)) {
+      f->upstreams[key] = upstream;
+    }
+  }
+
+  void clear_values(toonz::node_handle_t node) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = nodes_.find(node);
+    if (it != nodes_.end()) {
+      it->second.frames.clear();
+    }
+  }
+
+ private:
+  // handles of parameters, replaced as a whole by resolve()
+  typedef std::shared_ptr<std::vector<toonz::param_handle_t> const> Handles;
+
+  struct Frame {
+    Frame() : refs(0), valid(false) {}
+
+    int refs;
+    bool valid;
+    std::vector<double> values;
+    // keyed on rendering settings
+    std::unordered_map<CacheKey, Upstream, CacheKey::Hash> upstreams;
+  };
+
+  struct Node {
+    Handles handles;
+    std::map<double, Frame> frames;
+  };
+
+  Frame* find_frame(toonz::node_handle_t node, double frame) {
+    auto const it = nodes_.find(node);
+    if (it == nodes_.end()) {
+      return nullptr;
+    }
+    auto const jt = it->second.frames.find(frame);
+    return (jt != it->second.frames.end()) ? &jt->second : nullptr;
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<toonz::node_handle_t, Node> nodes_;
+};
+}
+
+namespace tnzu {
+struct Fx::State {
+  ResultCache cache;
+  FrameCache frames;
+  PersistentStore store;
+
+  // idle bloom engines
+  std::mutex bloom_mutex;
+  std::vector<std::unique_ptr<Bloom>> blooms;
+
+  void release_blooms() {
+    std::lock_guard<std::mutex> lock(bloom_mutex);
+    blooms.clear();
+  }
+};
+
+Fx::Fx() : handle_(nullptr), state_(new State()) {}
+
+Fx::~Fx() {}
+
+std::shared_ptr<Bloom> Fx::bloom() const {
+  State* const state = state_.get();
+
+  std::unique_ptr<Bloom> bloom;
+  {
+    std::lock_guard<std::mutex> lock(state->bloom_mutex);
+    if (!state->blooms.empty()) {
+      bloom = std::move(state->blooms.back());
+      state->blooms.pop_back();
+    }
+  }
+
+  if (!bloom) {
+    bloom.reset(new Bloom());
+  }
+
+  // returns the engine to the node, unless the node has been deleted
+  std::weak_ptr<State> const owner = state_;
+  return std::shared_ptr<Bloom>(bloom.release(), [owner](Bloom* p) {
+    std::unique_ptr<Bloom> engine(p);
+    if (std::shared_ptr<State> const state = owner.lock()) {
+      std::lock_guard<std::mutex> lock(state->bloom_mutex);
+      state->blooms.push_back(std::move(engine));
+    }
+  });
+}
+
+std::shared_ptr<void const> Fx::persistent(
+    std::string const& key, std::type_info const& type,
+    std::vector<double> const& values,
+    std::function<std::shared_ptr<void const>(std::size_t&)> const& make)
+    const {
+  return state_->store.get(key, std::type_index(type), values, make,
+                           persistent_budget());
+}
+
+CacheStats cache_stats() {
+  CacheStats const stats = {cache_hits.load(), cache_misses.load()};
+  return stats;
+}
+
+void reset_cache_stats() {
+  cache_hits = 0;
+  cache_misses = 0;
+}
+}
+
+namespace tnzu {
+TransferStats transfer_stats() {
+  TransferStats const stats = {copied_bytes.load(), aliased_bytes.load()};
+  return stats;
+}
+
+void reset_transfer_stats() {
+  copied_bytes = 0;
+  aliased_bytes = 0;
+}
+}
+
+namespace tnzu {
+int log_level() { return log_level_value.load(std::memory_order_relaxed); }
+
+void set_log_level(int level) { log_level_value = level; }
+
+void write_log(int level, std::string const& message) {
+  std::ostringstream out;
+  out << "[" << plugin_info()->name << " (" << std::this_thread::get_id()
+      << ")]: ";
+  if ((level > TNZU_LOG_LEVEL_NONE) && (level < TNZU_LOG_LEVEL_DEBUG)) {
+    out << log_level_names[level] << " ";
+  }
+  out << message << '\n';
+#ifdef _WIN32
+  OutputDebugStringA(out.str().c_str());
+#else
+  std::fputs(out.str().c_str(), stdout);
+#endif
+}
+
+TraceSpan::TraceSpan(char const* name)
+    : name_(name),
+      begin_(Tracer::instance().enabled() ? Tracer::instance().now() : -1) {}
+
+TraceSpan::~TraceSpan() {
+  if (begin_ >= 0) {
+    Tracer& tracer = Tracer::instance();
+    tracer.ring().push(name_, begin_, tracer.now());
+  }
+}
+
+void start_trace(std::string const& path) { Tracer::instance().start(path); }
+
+void stop_trace() { Tracer::instance().stop(); }
+
+bool write_trace(std::string const& path) {
+  return Tracer::instance().write(path);
+}
+}
+
+// converts pixels of tiles to and from images of a format other than
+// PIXEL_FORMAT_NATIVE
+class PixelConverter {
+ public:
+  PixelConverter(tnzu::Fx::PixelFormat format, int elem_type, double gamma)
+      : format_(format),
+        max_((elem_type == TOONZ_TILE_TYPE_32P) ? 0xff : 0xffff),
+        scale_(1.0f / max_) {
+    if ((format == tnzu::Fx::PIXEL_FORMAT_LINEAR) && (gamma > 0.0) &&
+        (gamma != 1.0)) {
+      // the shared tables of the power law
+      float const g = static_cast<float>(gamma);
+      if (elem_type == TOONZ_TILE_TYPE_32P) {
+        linear8_.reset(new Linear8(0.0f, g));
+      } else {
+        linear16_.reset(new Linear16(0.0f, g));
+      }
+    }
+  }
+
+  tnzu::Fx::PixelFormat format() const { return format_; }
+
+  // a zero cleared image of `size` pixels
+  cv::Mat create(cv::Size size) const {
+    if (format_ == tnzu::Fx::PIXEL_FORMAT_PLANAR) {
+      return zeros_pooled(cv::Size(size.width, size.height * 4), CV_32FC1);
+    }
+    return zeros_pooled(size, CV_32FC4);
+  }
+
+  // size in pixels of an image of the format, or an empty size if `mat` is
+  // not of the format
+  cv::Size size(cv::Mat const& mat) const {
+    if (format_ == tnzu::Fx::PIXEL_FORMAT_PLANAR) {
+      if ((mat.type() != CV_32FC1) || (mat.rows % 4 != 0)) {
+        return cv::Size();
+      }
+      return cv::Size(mat.cols, mat.rows / 4);
+    }
+    return (mat.type() == CV_32FC4) ? mat.size() : cv::Size();
+  }
+
+  // converts `width` pixels of `src` to `mat` at `pos`
+  template <typename T>
+  void read(T const* src, int width, cv::Mat& mat, cv::Point pos) const {
+    if (linear8_) {
+      return read(src, width, mat, pos, *linear8_);
+    }
+    if (linear16_) {
+      return read(src, width, mat, pos, *linear16_);
+    }
+    if (format_ != tnzu::Fx::PIXEL_FORMAT_PLANAR) {
+      // interleaved channels are converted as a flat row
+      int step = 0;
+      to_float(reinterpret_cast<float*>(mat.data + offset(mat, 0, pos, step)),
+               src->val, width * 4, scale_);
+      return;
+    }
+    for (int c = 0; c < 4; ++c) {
+      int step = 0;
+      float* dst =
+          reinterpret_cast<float*>(mat.data + offset(mat, c, pos, step));
+      for (int x = 0; x < width; ++x) {
+        dst[x * step] = src[x][c] * scale_;
+      }
+    }
+  }
+
+  // converts `width` pixels of `mat` at `pos` to `dst`
+  template <typename T>
+  void write(cv::Mat const& mat, cv::Point pos, int width, T* dst) const {
+    using value_type = typename T::value_type;
+    if (linear8_) {
+      return write(mat, pos, width, dst, *linear8_);
+    }
+    if (linear16_) {
+      return write(mat, pos, width, dst, *linear16_);
+    }
+    if (format_ != tnzu::Fx::PIXEL_FORMAT_PLANAR) {
+      int step = 0;
+      from_float(dst->val,
+                 reinterpret_cast<float const*>(mat.data +
+                                                offset(mat, 0, pos, step)),
+                 width * 4, static_cast<float>(max_));
+      return;
+    }
+    for (int c = 0; c < 4; ++c) {
+      int step = 0;
+      float const* src =
+          reinterpret_cast<float const*>(mat.data + offset(mat, c, pos, step));
+      for (int x = 0; x < width; ++x) {
+        dst[x][c] = cv::saturate_cast<value_type>(src[x * step] * max_);
+      }
+    }
+  }
+
+ private:
+  typedef tnzu::linear_color_space_converter<8> Linear8;
+  typedef tnzu::linear_color_space_converter<16> Linear16;
+
+  // colors through the tables of `linear`, and normalized alpha. colors are
+  // divided by alpha before the transfer and multiplied after, and those of
+  // transparent pixels, which add light, are transferred as they are.
+  template <typename T, typename Linear>
+  void read(T const* src, int width, cv::Mat& mat, cv::Point pos,
+            Linear const& linear) const {
+    int step = 0;
+    float* dst[4];
+    for (int c = 0; c < 4; ++c) {
+      dst[c] = reinterpret_cast<float*>(mat.data + offset(mat, c, pos, step));
+    }
+
+    std::uint32_t const max = static_cast<std::uint32_t>(max_);
+    for (int x = 0; x < width; ++x) {
+      std::uint32_t const a = src[x][3];
+      float const alpha = a * scale_;
+      for (int c = 0; c < 3; ++c) {
+        std::uint32_t const v = src[x][c];
+        dst[c][x * step] =
+            a ? linear[std::min(max, (v * max + a / 2) / a)] * alpha
+              : linear[v];
+      }
+      dst[3][x * step] = alpha;
+    }
+  }
+
+  template <typename T, typename Linear>
+  void write(cv::Mat const& mat, cv::Point pos, int width, T* dst,
+             Linear const& linear) const {
+    using value_type = typename T::value_type;
+
+    int step = 0;
+    float const* src[4];
+    for (int c = 0; c < 4; ++c) {
+      src[c] = reinterpret_cast<float const*>(mat.data +
+                                              offset(mat, c, pos, step));
+    }
+
+    std::uint32_t const max = static_cast<std::uint32_t>(max_);
+    for (int x = 0; x < width; ++x) {
+      std::uint32_t const a =
+          cv::saturate_cast<value_type>(src[3][x * step] * max_);
+      float const inv_alpha = a ? static_cast<float>(max_) / a : 1.0f;
+      for (int c = 0; c < 3; ++c) {
+        std::uint32_t const v = static_cast<std::uint32_t>(
+            linear.quantize(src[c][x * step] * inv_alpha));
+        dst[x][c] = static_cast<value_type>(a ? (v * a + max / 2) / max : v);
+      }
+      dst[x][3] = static_cast<value_type>(a);
+    }
+  }
+
+  static void to_float(float* dst, std::uint8_t const* src, int n,
+                       float scale) {
+    row_kernels->u8_to_f32(dst, src, n, scale);
+  }
+
+  static void to_float(float* dst, std::uint16_t const* src, int n,
+                       float scale) {
+    row_kernels->u16_to_f32(dst, src, n, scale);
+  }
+
+  static void from_float(std::uint8_t* dst, float const* src, int n,
+                         float scale) {
+    row_kernels->f32_to_u8(dst, src, n, scale);
+  }
+
+  static void from_float(std::uint16_t* dst, float const* src, int n,
+                         float scale) {
+    row_kernels->f32_to_u16(dst, src, n, scale);
+  }
+
+  // byte offset of the channel `c` at `pos`, and the step in floats to the
+  // next pixel
+  std::size_t offset(cv::Mat const& mat, int c, cv::Point pos,
+                     int& step) const {
+    if (format_ == tnzu::Fx::PIXEL_FORMAT_PLANAR) {
+      step = 1;
+      return (c * (mat.rows / 4) + pos.y) * mat.step[0] + pos.x * sizeof(float);
+    }
+    step = 4;
+    return pos.y * mat.step[0] + (pos.x * 4 + c) * sizeof(float);
+  }
+
+  tnzu::Fx::PixelFormat const format_;
+  int const max_;
+  float const scale_;
+  // tables of PIXEL_FORMAT_LINEAR for the bit depth of the tile
+  std::unique_ptr<Linear8> linear8_;
+  std::unique_ptr<Linear16> linear16_;
+};
+
+// wraps the tile memory as `mat` when the tile covers `size`,
+// otherwise copies the overlapping rows into a zero cleared image.
+// images of another format are converted while they are copied.
+template <typename T>
+bool to_mat(TileLock const& tile, cv::Size const size, cv::Mat& mat,
+            PixelConverter const* conv) {
+  if (!tile.data()) {
+    return false;
+  }
+
+  int const type = tnzu::opencv_type_traits<T>::value;
+  cv::Size const tile_size = tile.size();
+  std::size_t const row_bytes = size.width * sizeof(T);
+
+  int const width = std::min(size.width, tile_size.width);
+  int const height = std::min(size.height, tile_size.height);
+
+  if (conv) {
+    mat = conv->create(size);
+    if ((width > 0) && (height > 0)) {
+      parallel_bands(cv::Size(width, height), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+          T const* src =
+              reinterpret_cast<T const*>(tile.data() + y * tile.stride());
+          conv->read(src, width, mat, cv::Point(0, y));
+        }
+      });
+      copied_bytes += std::size_t(width) * height * sizeof(T);
+    }
+    return true;
+  }
+
+  if ((tile_size.width >= size.width) && (tile_size.height >= size.height) &&
+      (tile.stride() % sizeof(typename T::value_type) == 0)) {
+    mat = cv::Mat(size, type, tile.data(), tile.stride());
+    aliased_bytes += row_bytes * size.height;
+    return true;
+  }
+
+  mat = zeros_pooled(size, type);
+
+  for (int y = 0; y < height; ++y) {
+    std::memcpy(mat.ptr<T>(y), tile.data() + y * tile.stride(),
+                width * sizeof(T));
+  }
+  copied_bytes += std::size_t(std::max(width, 0)) * std::max(height, 0) *
+                  sizeof(T);
+
+  return true;
+}
+
+// copies the part of `mat` at `bbox` inside `bounds` to the tile.
+// images of another format are converted while they are copied.
+template <typename T>
+bool from_mat(TileLock const& tile, cv::Rect2d const& bounds,
+              toonz::rect_t bbox, cv::Mat const& mat,
+              PixelConverter const* conv) {
+  if (!tile.data()) {
+    return false;
+  }
+
+  cv::Size const mat_size = conv ? conv->size(mat) : mat.size();
+  if (conv ? (mat_size.area() == 0)
+           : (mat.type() != tnzu::opencv_type_traits<T>::value)) {
+    TNZU_LOG_WARNING("unexpected format of the result");
+    return false;
+  }
+
+  toonz::rect_t const& rect = tile.rect();
+
+  toonz::rect_t roi;
+  roi.x0 = std::max(std::max(rect.x0, bbox.x0), bounds.x);
+  roi.y0 = std::max(std::max(rect.y0, bbox.y0), bounds.y);
+  roi.x1 = std::min(std::min(rect.x1, bbox.x1), bounds.x + bounds.width);
+  roi.y1 = std::min(std::min(rect.y1, bbox.y1), bounds.y + bounds.height);
+
+  cv::Point const src_offset(std::max(0, static_cast<int>(roi.x0 - bbox.x0)),
+                             std::max(0, static_cast<int>(roi.y0 - bbox.y0)));
+
+  cv::Point const dst_offset(std::max(0, static_cast<int>(roi.x0 - rect.x0)),
+                             std::max(0, static_cast<int>(roi.y0 - rect.y0)));
+
+  cv::Size const size(std::min(static_cast<int>(roi.x1 - roi.x0),
+                               mat_size.width - src_offset.x),
+                      std::min(static_cast<int>(roi.y1 - roi.y0),
+                               mat_size.height - src_offset.y));
+
+  if ((size.width <= 0) || (size.height <= 0)) {
+    return true;
+  }
+
+  if (conv) {
+    parallel_bands(size, [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        T* dst = reinterpret_cast<T*>(tile.data() +
+                                      (y + dst_offset.y) * tile.stride() +
+                                      dst_offset.x * sizeof(T));
+        conv->write(mat, src_offset + cv::Point(0, y), size.width, dst);
+      }
+    });
+  } else {
+    for (int y = 0; y < size.height; ++y) {
+      T const* src = mat.ptr<T>(y + src_offset.y) + src_offset.x;
+      std::uint8_t* dst = tile.data() + (y + dst_offset.y) * tile.stride() +
+                          dst_offset.x * sizeof(T);
+      std::memcpy(dst, src, size.width * sizeof(T));
+    }
+  }
+  copied_bytes += std::size_t(size.width) * size.height * sizeof(T);
+
+  return true;
+}
+
+inline cv::Rect2d to_rect2d(toonz::rect_t const& rect) {
+  return cv::Rect2d(rect.x0, rect.y0, rect.x1 - rect.x0, rect.y1 - rect.y0);
+}
+
+inline toonz::rect_t to_rect_t(cv::Rect2d const& rect) {
+  toonz::rect_t const retval = {rect.x, rect.y, rect.x + rect.width,
+                                rect.y + rect.height};
+  return retval;
+}
+
+inline bool is_finite(cv::Rect2d const& rect) {
+  return std::isfinite(rect.x) && std::isfinite(rect.y) &&
+         std::isfinite(rect.width) && std::isfinite(rect.height);
+}
+
+// the part of `rect` covered by `roi`, snapped outward to the pixel grid of
+// `rect`. an infinite `roi` covers everything.
+cv::Rect2d clip_rect(cv::Rect2d const& rect, cv::Rect2d const& roi) {
+  if (!is_finite(roi)) {
+    return rect;
+  }
+
+  double const x0 = std::floor(std::max(0.0, roi.x - rect.x));
+  double const y0 = std::floor(std::max(0.0, roi.y - rect.y));
+  double const x1 = std::ceil(std::min(rect.width, roi.x + roi.width - rect.x));
+  double const y1 =
+      std::ceil(std::min(rect.height, roi.y + roi.height - rect.y));
+
+  return cv::Rect2d(rect.x + x0, rect.y + y0, std::max(0.0, x1 - x0),
+                    std::max(0.0, y1 - y0));
+}
+
+// wraps the part of the tile at `pos` as `mat`, when `bounds` in the tile
+// covers it at an integral offset
+template <typename T>
+bool tile_view(TileLock const& tile, cv::Rect2d const& bounds,
+               cv::Point2d const pos, cv::Size const size, cv::Mat& mat) {
+  if (!tile.data() || (tile.stride() % sizeof(typename T::value_type) != 0)) {
+    return false;
+  }
+
+  toonz::rect_t const& rect = tile.rect();
+
+  double const x = pos.x - rect.x0;
+  double const y = pos.y - rect.y0;
+  if ((x != std::floor(x)) || (y != std::floor(y)) || (pos.x < bounds.x) ||
+      (pos.y < bounds.y) || (pos.x < rect.x0) || (pos.y < rect.y0) ||
+      (pos.x + size.width > std::min(bounds.x + bounds.width, rect.x1)) ||
+      (pos.y + size.height > std::min(bounds.y + bounds.height, rect.y1))) {
+    return false;
+  }
+
+  mat = cv::Mat(size, tnzu::opencv_type_traits<T>::value,
+                tile.data() + static_cast<int>(y) * tile.stride() +
+                    static_cast<int>(x) * sizeof(T),
+                tile.stride());
+  return true;
+}
+
+tnzu::Fx::Config make_config(const toonz_rendering_setting_t* rs,
+                             double frame) {
+  tnzu::Fx::Config cfg = {
+      rs->affine, rs->gamma, rs->time_stretch_from, rs->time_stretch_to,
+      rs->stereo_scopic_shift, rs->bpp, rs->max_tile_size, rs->quality,
+      rs->field_prevalence, rs->stereoscopic, rs->is_swatch, rs->user_cachable,
+      rs->apply_shrink_to_viewer, static_cast<int>(frame),
+  };
+  cfg.scale = 1.0;
+  return cfg;
+}
+
+bool get_params(toonz_node_handle_t node, tnzu::Fx const* fx, double frame,
+                tnzu::Fx::Params& params) {
+  return fx->state()->frames.get(node, fx, frame, params);
+}
+
+bool is_fullscreen(toonz::rect_t const& bbox) {
+  return (bbox.x0 == -std::numeric_limits<double>::max()) ||
+         (bbox.y0 == -std::numeric_limits<double>::max()) ||
+         (bbox.x1 == std::numeric_limits<double>::max()) ||
+         (bbox.y1 == std::numeric_limits<double>::max());
+}
+
+// union of `ports` enlarged by the effect. bboxes of fullscreen inputs are
+// replaced by `screen` if it is given.
+cv::Rect2d enlarge_ports(tnzu::Fx* fx, tnzu::Fx::Config const& cfg,
+                         tnzu::Fx::Params const& params,
+                         std::vector<Port> const& ports,
+                         toonz::rect_t const* screen) {
+  toonz::rect_t bbox;
+
+  bbox.x0 = +std::numeric_limits<double>::infinity();
+  bbox.y0 = +std::numeric_limits<double>::infinity();
+  bbox.x1 = -std::numeric_limits<double>::infinity();
+  bbox.y1 = -std::numeric_limits<double>::infinity();
+
+  for (Port const& port : ports) {
+    toonz::rect_t const& inbbox =
+        (screen && is_fullscreen(port.bbox)) ? *screen : port.bbox;
+    bbox.x0 = std::min(bbox.x0, inbbox.x0);
+    bbox.y0 = std::min(bbox.y0, inbbox.y0);
+    bbox.x1 = std::max(bbox.x1, inbbox.x1);
+    bbox.y1 = std::max(bbox.y1, inbbox.y1);
+  }
+
+  cv::Rect2d rect(bbox.x0, bbox.y0, bbox.x1 - bbox.x0, bbox.y1 - bbox.y0);
+  fx->enlarge(cfg, params, rect);
+  return rect;
+}
+
+// bboxes of upstream nodes, which are queried once per frame and shared by
+// do_get_bbox and tiles of do_compute
+Upstream get_upstream(toonz_node_handle_t node, tnzu::Fx* fx,
+                      const toonz_rendering_setting_t* rs, double frame,
+                      tnzu::Fx::Config const& cfg,
+                      tnzu::Fx::Params const& params) {
+  CacheKey key;
+  key.push(cfg.affine.a11);
+  key.push(cfg.affine.a12);
+  key.push(cfg.affine.a13);
+  key.push(cfg.affine.a21);
+  key.push(cfg.affine.a22);
+  key.push(cfg.affine.a23);
+  key.push(cfg.stereo_scopic_shift);
+  key.push(static_cast<std::uint64_t>(cfg.bpp));
+  key.push(static_cast<std::uint64_t>(cfg.quality));
+  key.push(static_cast<std::uint64_t>(cfg.is_swatch));
+  key.push(static_cast<std::uint64_t>(cfg.apply_shrink_to_viewer));
+
+  Upstream upstream;
+  if (fx->state()->frames.find_upstream(node, frame, key, upstream)) {
+    return upstream;
+  }
+
+  for (int i = 0, argc = fx->port_count(); i < argc; i++) {
+    toonz::port_handle_t port = nullptr;
+    nodeif->get_input_port(node, fx->port_name(i), &port);
+    if (!port) {
+      TNZU_LOG_WARNING("null port");
+      continue;
+    }
+
+    int con = 0;
+    portif->is_connected(port, &con);
+    if (!con) {
+      TNZU_LOG_WARNING("disconnected port");
+      continue;
+    }
+
+    toonz::fxnode_handle_t fxnode = nullptr;
+    portif->get_fx(port, &fxnode);
+    if (!fxnode) {
+      TNZU_LOG_WARNING("invalid port");
+      continue;
+    }
+
+    int got = 0;
+    toonz::rect_t inbbox;
+    fxif->get_bbox(fxnode, rs, frame, &inbbox, &got);
+    if (!got) {
+      TNZU_LOG_WARNING("could not get bbox");
+      continue;
+    }
+
+    Port const p = {i, fxnode, inbbox};
+    upstream.ports.push_back(p);
+  }
+
+  upstream.rect = enlarge_ports(fx, cfg, params, upstream.ports, nullptr);
+
+  fx->state()->frames.store_upstream(node, frame, key, upstream);
+  return upstream;
+}
+
+// an input port of do_compute
+struct Input {
+  inline Input(int port, toonz::fxnode_handle_t fxnode, toonz::rect_t bbox,
+               bool fullscreen)
+      : port(port),
+        fxnode(fxnode),
+        bbox(bbox),
+        fullscreen(fullscreen),
+        format(tnzu::Fx::PIXEL_FORMAT_NATIVE),
+        conv(nullptr),
+        valid(false) {}
+
+  int port;
+  toonz::fxnode_handle_t fxnode;
+  toonz::rect_t bbox;  // requested region
+  bool fullscreen;
+  tnzu::Fx::PixelFormat format;
+  PixelConverter const* conv;  // null for PIXEL_FORMAT_NATIVE
+  std::unique_ptr<InputTile> tile;
+  cv::Mat mat;
+  bool valid;
+};
+
+// computes an input by the upstream node and converts it to cv::Mat
+void fetch_input(Input& in, const toonz_rendering_setting_t* rs, double frame,
+                 int elem_type) {
+  if ((in.bbox.x1 <= in.bbox.x0) || (in.bbox.y1 <= in.bbox.y0)) {
+    // the input does not contribute to the tile
+    if (in.conv) {
+      in.mat = in.conv->create(cv::Size(0, 0));
+    } else {
+      in.mat = cv::Mat(0, 0, (elem_type == TOONZ_TILE_TYPE_32P) ? CV_8UC4
+                                                                : CV_16UC4);
+    }
+    in.valid = true;
+    return;
   }
 
-  if (dst_offset.y + src_size.height > dst_size.height) {
-    src_size.height = dst_size.height - dst_offset.y;
+  in.tile.reset(new InputTile());
+  if (!in.tile->handle) {
+    return;
+  }
+  {
+    TNZU_TRACE_SPAN("compute_to_tile");
+    fxif->compute_to_tile(in.fxnode, rs, frame, &in.bbox, NULL,
+                          in.tile->handle);
   }
 
-  if ((src_size.width <= 0) || (src_size.height <= 0)) {
+  int in_elem_type = TOONZ_TILE_TYPE_32P;
+  tileif->get_element_type(in.tile->handle, &in_elem_type);
+  if (in_elem_type != elem_type) {
+    TNZU_LOG_WARNING("unsupported pixel format");
     return;
   }
 
-  cv::Point2d t(src_offset.x - std::floor(src_offset.x),
-                src_offset.y - std::floor(src_offset.y));
+  cv::Size const insize(static_cast<int>(in.bbox.x1 - in.bbox.x0),
+                        static_cast<int>(in.bbox.y1 - in.bbox.y0));
 
-  if (src.type() == CV_8UC4) {
-    copy_image<cv::Vec4b>(src_offset, src, dst_offset, dst, src_size, t);
+  in.tile->lock.reset(new TileLock(in.tile->handle));
+
+  TNZU_TRACE_SPAN("to_mat");
+  if (elem_type == TOONZ_TILE_TYPE_32P) {
+    TNZU_LOG_INFO("input elem_type = TOONZ_TILE_TYPE_32P");
+    in.valid = to_mat<cv::Vec4b>(*in.tile->lock, insize, in.mat, in.conv);
   } else {
-    copy_image<cv::Vec4w>(src_offset, src, dst_offset, dst, src_size, t);
+    TNZU_LOG_INFO("input elem_type = TOONZ_TILE_TYPE_64P");
+    in.valid = to_mat<cv::Vec4w>(*in.tile->lock, insize, in.mat, in.conv);
   }
 }
 
-std::size_t hash(cv::Mat const& m) {
-  static std::size_t const FNV_OFFSET_BASIS = 14695981039346656037LLU;
-  static std::size_t const FNV_PRIME = 1099511628211LLU;
-  static std::size_t const SAMPLE_SIZE = 256;
+// a key of the result computed from `args` in `rect`, written to `outrect`
+CacheKey make_cache_key(tnzu::Fx const* fx, tnzu::Fx::Config const& cfg,
+                        tnzu::Fx::Params const& params,
+                        tnzu::Fx::Args const& args, int elem_type,
+                        cv::Rect2d const& rect, cv::Rect2d const& outrect) {
+  CacheKey key;
 
-  std::size_t const size = m.cols * m.rows * m.elemSize();
-
-  // sample by Van der Corput sequence
-  std::size_t h = FNV_OFFSET_BASIS;
-  for (std::size_t i = 1; i <= SAMPLE_SIZE; ++i) {
-    // sample point
-    double const j =
-        tnzu::bit_reverse(i) / (std::numeric_limits<std::size_t>::max() + 1.0);
-    std::size_t const k = static_cast<std::size_t>(j * size);
-
-    // update hash value
-    h *= FNV_PRIME;
-    h ^= m.data[k];
+  for (int i = 0, paramc = fx->param_count(); i < paramc; i++) {
+    key.push(params[i]);
   }
-  return h;
-}
 
-void generate_bloom(cv::Mat& img, int level, int radius) {
-  std::vector<cv::Mat> dst(level + 1);
-
-  cv::Size const ksize(radius * 2 + 1, radius * 2 + 1);
+  key.push(cfg.affine.a11);
+  key.push(cfg.affine.a12);
+  key.push(cfg.affine.a13);
+  key.push(cfg.affine.a21);
+  key.push(cfg.affine.a22);
+  key.push(cfg.affine.a23);
+  key.push(cfg.gamma);
+  key.push(cfg.time_stretch_from);
+  key.push(cfg.time_stretch_to);
+  key.push(cfg.stereo_scopic_shift);
+  key.push(static_cast<std::uint64_t>(cfg.bpp));
+  key.push(static_cast<std::uint64_t>(cfg.quality));
+  key.push(static_cast<std::uint64_t>(cfg.field_prevalence));
+  key.push(static_cast<std::uint64_t>(cfg.stereoscopic));
+  key.push(static_cast<std::uint64_t>(cfg.is_swatch));
+  key.push(static_cast<std::uint64_t>(cfg.apply_shrink_to_viewer));
+  key.push(static_cast<std::uint64_t>(cfg.frame));
+  key.push(static_cast<std::uint64_t>(elem_type));
+
+  for (cv::Rect2d const& r : {rect, outrect}) {
+    key.push(r.x);
+    key.push(r.y);
+    key.push(r.width);
+    key.push(r.height);
+  }
 
-  cv::Mat tmp;
-  int i;
-  cv::Size size = img.size();
-  for (i = 0; i <= level;) {
-    if (i) {
-      cv::resize(img, tmp, size / 2, 0.0, 0.0, cv::INTER_AREA);
-      img = tmp;
-      size = img.size();
+  for (int i = 0, argc = args.count(); i < argc; i++) {
+    if (args.invalid(i)) {
+      key.push(std::uint64_t(0));
+      continue;
     }
-
-    cv::GaussianBlur(img, dst[i], ksize, 0.0);
-
-    ++i;
-
-    if ((size.width <= 1) || (size.height <= 1)) {
-      break;
+    key.push(std::uint64_t(1));
+    key.push(args.offset(i).x);
+    key.push(args.offset(i).y);
+    key.push(static_cast<std::uint64_t>(args.get(i).cols));
+    key.push(static_cast<std::uint64_t>(args.get(i).rows));
+    if (!args.get(i).empty()) {
+      key.push(static_cast<std::uint64_t>(tnzu::hash(args.get(i))));
     }
   }
 
-  for (--i; i > 0; --i) {
-    cv::resize(dst[i], tmp, dst[i - 1].size());
-    dst[i - 1] += tmp;
-  }
-  img = dst[0];
-}
+  return key;
 }
 
-//
-// tnzu
-//
-template <typename T>
-bool to_mat(toonz::tile_handle_t tile, cv::Mat& mat) {
-  mat = cv::Scalar(0, 0, 0, 0);
-
-  toonz::rect_t rect;
-  tileif->get_rectangle(tile, &rect);
-
-  cv::Size const size(static_cast<int>(rect.x1 - rect.x0),
-                      static_cast<int>(rect.y1 - rect.y0));
+// computes the part of the result in `outrect` from `ports`, and writes it
+// to the tile. `rect` is the area of the result to compute, which is clipped
+// to the region require() relates to `outrect`.
+void compute_rect(tnzu::Fx* fx, tnzu::Fx::Config const& cfg,
+                  tnzu::Fx::Params const& params,
+                  const toonz_rendering_setting_t* rs, double frame,
+                  int elem_type, std::vector<Input> const& ports,
+                  cv::Rect2d rect, cv::Rect2d const& outrect,
+                  TileLock const& out) {
+  // input region required for `outrect`
+  cv::Rect2d inrect = outrect;
+  fx->require(cfg, params, inrect);
+
+  rect = clip_rect(rect, inrect);
+  toonz::rect_t const bbox = to_rect_t(rect);
+
+  // converters of formats other than PIXEL_FORMAT_NATIVE, shared by inputs
+  // and the result
+  std::unique_ptr<PixelConverter> converters[4];
+  auto const converter =
+      [&](tnzu::Fx::PixelFormat format) -> PixelConverter const* {
+    if ((format <= tnzu::Fx::PIXEL_FORMAT_NATIVE) ||
+        (format > tnzu::Fx::PIXEL_FORMAT_PLANAR)) {
+      return nullptr;
+    }
+    std::unique_ptr<PixelConverter>& conv = converters[format];
+    if (!conv) {
+      conv.reset(new PixelConverter(format, elem_type, cfg.gamma));
+    }
+    return conv.get();
+  };
 
-  int stride = 0;
-  tileif->get_raw_stride(tile, &stride);
-  stride /= sizeof(typename T::value_type);
+  // keeps input tiles alive while `args` refers to them
+  std::vector<Input> inputs;
+  inputs.reserve(ports.size());
+  for (Input const& port : ports) {
+    inputs.push_back(
+        Input(port.port, port.fxnode, port.bbox, port.fullscreen));
+
+    Input& in = inputs.back();
+    in.conv = converter(fx->port_format(in.port));
+    in.format = in.conv ? in.conv->format() : tnzu::Fx::PIXEL_FORMAT_NATIVE;
+    if (!in.fullscreen) {
+      in.bbox = to_rect_t(clip_rect(to_rect2d(in.bbox), inrect));
+    } else if (is_finite(inrect)) {
+      in.bbox.x0 = std::floor(inrect.x);
+      in.bbox.y0 = std::floor(inrect.y);
+      in.bbox.x1 = std::ceil(inrect.x + inrect.width);
+      in.bbox.y1 = std::ceil(inrect.y + inrect.height);
+    }
+  }
 
-  typename T::value_type* data;
-  tileif->get_raw_address_unsafe(tile, reinterpret_cast<void**>(&data));
-  if (!data) {
-    tileif->safen(tile);
-    return false;
+  // upstream nodes render concurrently, and each input is converted as soon
+  // as it arrives
+  tnzu::parallel_for(
+      static_cast<int>(inputs.size()), fx->input_concurrency(),
+      [&](int k) { fetch_input(inputs[k], rs, frame, elem_type); });
+
+  tnzu::Fx::Args args(fx->port_count());
+  for (Input const& in : inputs) {
+    if (in.valid) {
+      // offsets are often negatives, when using an fullscreen effect
+      args.set(in.port, in.mat,
+               cv::Point2d(in.bbox.x0 - bbox.x0, in.bbox.y0 - bbox.y0),
+               in.format);
+    }
   }
 
-  for (int y = 0; y < size.height; ++y) {
-    T* dst = mat.ptr<T>(y);
-    for (int x = 0; x < size.width; ++x) {
-      int p = y * stride + x * 4;
-      for (int c = 0; c < 4; c++) {
-        dst[x][c] = data[p++];
+  // reuses a cached result
+  std::size_t const budget = fx->cache_budget();
+  CacheKey key;
+  if (budget > 0) {
+    key = make_cache_key(fx, cfg, params, args, elem_type, rect, outrect);
+
+    cv::Mat cached;
+    if (fx->state()->cache.find(key, cached)) {
+      ++cache_hits;
+      if (elem_type == TOONZ_TILE_TYPE_32P) {
+        from_mat<cv::Vec4b>(out, outrect, to_rect_t(outrect), cached,
+                            nullptr);
+      } else {
+        from_mat<cv::Vec4w>(out, outrect, to_rect_t(outrect), cached,
+                            nullptr);
       }
+      return;
     }
+    ++cache_misses;
   }
 
-  tileif->safen(tile);
-  return true;
-}
+  cv::Size const retsize(static_cast<int>(std::ceil(rect.width)),
+                         static_cast<int>(std::ceil(rect.height)));
 
-template <typename T>
-bool from_mat(toonz::tile_handle_t tile, toonz::rect_t bbox,
-              cv::Mat const& mat) {
-  typename T::value_type* data;
-  tileif->get_raw_address_unsafe(tile, reinterpret_cast<void**>(&data));
-  if (!data) {
-    tileif->safen(tile);
-    return false;
-  }
+  PixelConverter const* const out_conv = converter(fx->output_format());
 
-  int stride = 0;
-  tileif->get_raw_stride(tile, &stride);
-  stride /= sizeof(typename T::value_type);
+  // renders straight into the tile when `outrect` covers the result
+  cv::Mat retimg;
+  bool direct = false;
+  if (!out_conv && (elem_type == TOONZ_TILE_TYPE_32P)) {
+    direct = tile_view<cv::Vec4b>(out, outrect, rect.tl(), retsize, retimg);
+  } else if (!out_conv) {
+    direct = tile_view<cv::Vec4w>(out, outrect, rect.tl(), retsize, retimg);
+  }
 
-  toonz::rect_t rect;
-  tileif->get_rectangle(tile, &rect);
+  if (direct) {
+    retimg = cv::Scalar(0, 0, 0, 0);
+  } else if (out_conv) {
+    retimg = out_conv->create(retsize);
+  } else if (elem_type == TOONZ_TILE_TYPE_32P) {
+    retimg = zeros_pooled(retsize, CV_8UC4);
+  } else {
+    retimg = zeros_pooled(retsize, CV_16UC4);
+  }
 
-  toonz::rect_t roi;
-  roi.x0 = std::max(rect.x0, bbox.x0);
-  roi.y0 = std::max(rect.y0, bbox.y0);
-  roi.x1 = std::min(rect.x1, bbox.x1);
-  roi.y1 = std::min(rect.y1, bbox.y1);
+  std::uint8_t const* const retdata = retimg.data;
 
-  cv::Point const src_offset(std::max(0, static_cast<int>(roi.x0 - bbox.x0)),
-                             std::max(0, static_cast<int>(roi.y0 - bbox.y0)));
+  tnzu::Fx::Config config = cfg;
+  config.origin = rect.tl();
 
-  cv::Point const dst_offset(std::max(0, static_cast<int>(roi.x0 - rect.x0)),
-                             std::max(0, static_cast<int>(roi.y0 - rect.y0)));
+  {
+    TNZU_TRACE_SPAN("Fx::compute");
+    fx->compute(config, params, args, retimg);
+  }
 
-  cv::Size const size(static_cast<int>(roi.x1 - roi.x0),
-                      static_cast<int>(roi.y1 - roi.y0));
+  TNZU_TRACE_SPAN("from_mat");
 
-  for (int y = 0; y < size.height; ++y) {
-    T const* src = mat.ptr<T>(y + src_offset.y);
-    for (int x = 0; x < size.width; ++x) {
-      int p = x + src_offset.x;
-      int q = (y + dst_offset.y) * stride + (x + dst_offset.x) * 4;
-      for (int c = 0; c < 4; ++c) {
-        data[q++] = src[p][c];
-      }
+  if (direct && (retimg.data == retdata) && (retimg.size() == retsize)) {
+    // `retimg` still refers to the tile
+    aliased_bytes += retimg.total() * retimg.elemSize();
+  } else if (elem_type == TOONZ_TILE_TYPE_32P) {
+    TNZU_LOG_INFO("output elem_type = TOONZ_TILE_TYPE_32P");
+    if (!from_mat<cv::Vec4b>(out, outrect, bbox, retimg, out_conv)) {
+      TNZU_LOG_WARNING("fail copying to the tile");
+      return;
+    }
+  } else {
+    TNZU_LOG_INFO("output elem_type = TOONZ_TILE_TYPE_64P");
+    if (!from_mat<cv::Vec4w>(out, outrect, bbox, retimg, out_conv)) {
+      TNZU_LOG_WARNING("fail copying to the tile");
+      return;
     }
   }
 
-  tileif->safen(tile);
-  return true;
-}
-
-//
-// implementation
-//
-extern "C" {
-
-void do_compute(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
-                double frame, toonz_tile_handle_t tile) {
-  tnzu::Fx* fx = nullptr;
-  nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
+  if (budget > 0) {
+    cv::Rect const roi(static_cast<int>(std::round(outrect.x - rect.x)),
+                       static_cast<int>(std::round(outrect.y - rect.y)),
+                       static_cast<int>(std::ceil(outrect.width)),
+                       static_cast<int>(std::ceil(outrect.height)));
+    cv::Mat view;
+    if (!out_conv) {
+      if ((roi & cv::Rect(0, 0, retimg.cols, retimg.rows)) == roi) {
+        view = retimg(roi);
+      }
+    } else if (elem_type == TOONZ_TILE_TYPE_32P) {
+      // caches converted pixels written to the tile
+      tile_view<cv::Vec4b>(out, outrect, outrect.tl(), roi.size(), view);
+    } else {
+      tile_view<cv::Vec4w>(out, outrect, outrect.tl(), roi.size(), view);
+    }
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
-  if (!fx) {
-    return;
+    if (!view.empty()) {
+      fx->state()->cache.insert(key, view.clone(), budget);
+    }
   }
+}
 
-  int elem_type = TOONZ_TILE_TYPE_32P;
-  tileif->get_element_type(tile, &elem_type);
-  if ((elem_type != TOONZ_TILE_TYPE_32P) &&
-      (elem_type != TOONZ_TILE_TYPE_64P)) {
-    DEBUG_PRINT("WARNING unsupported pixel format");
-    return;
+// splits `outrect` into sub-tiles, such that buffers of each sub-tile
+// including its margin fit in Config::max_tile_size megabytes. nothing is
+// split when the whole fits, or when require() asks for whole inputs.
+std::vector<cv::Rect2d> split_rect(tnzu::Fx* fx, tnzu::Fx::Config const& cfg,
+                                   tnzu::Fx::Params const& params,
+                                   cv::Rect2d const& rect,
+                                   cv::Rect2d const& outrect, int inputc,
+                                   int elem_type) {
+  std::vector<cv::Rect2d> subrects;
+  if (cfg.max_tile_size <= 0) {
+    return subrects;
   }
 
-  int const paramc = fx->param_count();
-  tnzu::Fx::Params params(paramc);
-  for (int i = 0; i < paramc; i++) {
-    toonz::param_handle_t param = nullptr;
-    if (int const ret =
-            nodeif->get_param(node, fx->param_prototype(i)->name, &param)) {
-      return;
-    }
+  double const bpp = (elem_type == TOONZ_TILE_TYPE_32P) ? 4 : 8;
+  double const budget = cfg.max_tile_size * 1024.0 * 1024.0;
+
+  // bytes of the result in `r` and of the inputs it requires. `whole` is set
+  // if they are whole inputs, which every sub-tile would fetch again.
+  auto const bytes = [&](cv::Rect2d const& r, bool& whole) {
+    cv::Rect2d inrect = r;
+    fx->require(cfg, params, inrect);
+    inrect = clip_rect(rect, inrect);
+    whole = (inrect.width >= rect.width) && (inrect.height >= rect.height);
+    return (r.area() + inputc * inrect.area()) * bpp;
+  };
 
-    int size_in_elements = 1;
-    paramif->get_value(param, frame, &size_in_elements, &params[i]);
+  bool whole = false;
+  if (bytes(outrect, whole) <= budget) {
+    return subrects;
   }
 
-  int const argc = fx->port_count();
-  tnzu::Fx::Args args(argc);
-
-  toonz::rect_t bbox;
-
-  bbox.x0 = +std::numeric_limits<double>::infinity();
-  bbox.y0 = +std::numeric_limits<double>::infinity();
-  bbox.x1 = -std::numeric_limits<double>::infinity();
-  bbox.y1 = -std::numeric_limits<double>::infinity();
-
-  for (int i = 0; i < argc; i++) {
-    toonz::port_handle_t port = nullptr;
-    nodeif->get_input_port(node, fx->port_name(i), &port);
-    if (!port) {
-      DEBUG_PRINT("WARNING null port");
-      continue;
-    }
-
-    int con = 0;
-    portif->is_connected(port, &con);
-    if (!con) {
-      DEBUG_PRINT("WARNING disconnected port");
-      continue;
+  double const min_side = 64;
+  double side = std::max(
+      min_side, std::floor(std::sqrt(budget / (bpp * (inputc + 1)))));
+  for (;;) {
+    double const b =
+        bytes(cv::Rect2d(outrect.x, outrect.y, side, side), whole);
+    if (whole) {
+      return subrects;
     }
-
-    toonz::fxnode_handle_t fx = nullptr;
-    portif->get_fx(port, &fx);
-    if (!fx) {
-      DEBUG_PRINT("WARNING invalid port");
-      continue;
+    if ((b <= budget) || (side <= min_side)) {
+      break;
     }
+    side = std::max(min_side, std::floor(side * 0.75));
+  }
 
-    int got = 0;
-    toonz::rect_t inbbox;
-    fxif->get_bbox(fx, rs, frame, &inbbox, &got);
-    if (!got) {
-      DEBUG_PRINT("WARNING could not get bbox");
-      continue;
-    }
+  if ((side >= outrect.width) && (side >= outrect.height)) {
+    return subrects;
+  }
 
-    if ((inbbox.x0 == -std::numeric_limits<double>::max()) ||
-        (inbbox.y0 == -std::numeric_limits<double>::max()) ||
-        (inbbox.x1 == std::numeric_limits<double>::max()) ||
-        (inbbox.y1 == std::numeric_limits<double>::max())) {
-      // fullscreen effect
-      DEBUG_PRINT("fullscreen");
-      tileif->get_rectangle(tile, &inbbox);
+  for (double y = 0; y < outrect.height; y += side) {
+    for (double x = 0; x < outrect.width; x += side) {
+      subrects.push_back(cv::Rect2d(outrect.x + x, outrect.y + y,
+                                    std::min(side, outrect.width - x),
+                                    std::min(side, outrect.height - y)));
     }
+  }
+  return subrects;
+}
 
-    toonz::tile_handle_t intile = nullptr;
-    tileif->create(&intile);
-    if (!intile) {
-      continue;
-    }
-    fxif->compute_to_tile(fx, rs, frame, &inbbox, NULL, intile);
+// computes the result into `out` at the resolution of `rs`
+void render_tile(toonz_node_handle_t node, tnzu::Fx* fx,
+                 const toonz_rendering_setting_t* rs,
+                 tnzu::Fx::Config const& cfg, double frame, int elem_type,
+                 tnzu::Fx::Params const& params, TileLock const& out) {
+  toonz::rect_t const& tilerect = out.rect();
 
-    int in_elem_type = TOONZ_TILE_TYPE_32P;
-    tileif->get_element_type(intile, &in_elem_type);
-    if ((elem_type != TOONZ_TILE_TYPE_32P) &&
-        (elem_type != TOONZ_TILE_TYPE_64P)) {
-      DEBUG_PRINT("WARNING unsupported pixel format");
-      tileif->destroy(intile);
-      continue;
-    }
+  Upstream const upstream = get_upstream(node, fx, rs, frame, cfg, params);
 
-    cv::Size const insize(static_cast<int>(inbbox.x1 - inbbox.x0),
-                          static_cast<int>(inbbox.y1 - inbbox.y0));
+  // connected input ports
+  std::vector<Input> ports;
+  ports.reserve(upstream.ports.size());
 
-    cv::Mat mat;
-    if (elem_type == TOONZ_TILE_TYPE_32P) {
-      DEBUG_PRINT("INFO input elem_type = TOONZ_TILE_TYPE_32P");
-      mat = cv::Mat(insize, CV_8UC4);
-      if (!to_mat<cv::Vec4b>(intile, mat)) {
-        tileif->destroy(intile);
-        continue;
-      }
+  bool fullscreen = false;
+  for (Port const& port : upstream.ports) {
+    if (is_fullscreen(port.bbox)) {
+      // fullscreen effect
+      TNZU_LOG_DEBUG("fullscreen");
+      ports.push_back(Input(port.index, port.fxnode, tilerect, true));
+      fullscreen = true;
     } else {
-      DEBUG_PRINT("INFO input elem_type = TOONZ_TILE_TYPE_64P");
-      mat = cv::Mat(insize, CV_16UC4);
-      if (!to_mat<cv::Vec4w>(intile, mat)) {
-        tileif->destroy(intile);
-        continue;
-      }
+      ports.push_back(Input(port.index, port.fxnode, port.bbox, false));
     }
-
-    bbox.x0 = std::min(bbox.x0, inbbox.x0);
-    bbox.y0 = std::min(bbox.y0, inbbox.y0);
-    bbox.x1 = std::max(bbox.x1, inbbox.x1);
-    bbox.y1 = std::max(bbox.y1, inbbox.y1);
-
-    args.set(i, mat, cv::Point2d(inbbox.x0, inbbox.y0));
-
-    tileif->destroy(intile);
   }
 
-  tnzu::Fx::Config const cfg = {
-      rs->affine, rs->gamma, rs->time_stretch_from, rs->time_stretch_to,
-      rs->stereo_scopic_shift, rs->bpp, rs->max_tile_size, rs->quality,
-      rs->field_prevalence, rs->stereoscopic, rs->is_swatch, rs->user_cachable,
-      rs->apply_shrink_to_viewer, static_cast<int>(frame),
-  };
-
-  cv::Rect2d rect(bbox.x0, bbox.y0, bbox.x1 - bbox.x0, bbox.y1 - bbox.y0);
-  fx->enlarge(cfg, params, rect);
+  // bboxes of fullscreen inputs depend on the tile
+  cv::Rect2d rect =
+      fullscreen ? enlarge_ports(fx, cfg, params, upstream.ports, &tilerect)
+                 : upstream.rect;
 
   if ((rect.width <= 0.0) || (rect.height <= 0.0)) {
-    DEBUG_PRINT("WARNING null rectangle");
+    TNZU_LOG_WARNING("null rectangle");
     return;
   }
 
   if (!std::isfinite(rect.x) || !std::isfinite(rect.y) ||
       !std::isfinite(rect.width) || !std::isfinite(rect.height)) {
     // fullscreen effect
+    rect = to_rect2d(tilerect);
+  }
 
-    tileif->get_rectangle(tile, &bbox);
-    rect.x = bbox.x0;
-    rect.y = bbox.y0;
-    rect.width = bbox.x1 - bbox.x0;
-    rect.height = bbox.y1 - bbox.y0;
-  } else {
-    bbox.x0 = rect.x;
-    bbox.y0 = rect.y;
-    bbox.x1 = rect.x + rect.width;
-    bbox.y1 = rect.y + rect.height;
+  // the part of the result written to the tile
+  cv::Rect2d const outrect = clip_rect(rect, to_rect2d(tilerect));
+  if ((outrect.width <= 0.0) || (outrect.height <= 0.0)) {
+    return;
   }
 
-  for (int i = 0, count = fx->port_count(); i < count; i++) {
-    // offsets are often negatives, when using an fullscreen effect
-    args.offset(i).x -= bbox.x0;
-    args.offset(i).y -= bbox.y0;
+  std::vector<cv::Rect2d> subrects;
+  if (fx->use_subtiles()) {
+    subrects = split_rect(fx, cfg, params, rect, outrect,
+                          static_cast<int>(ports.size()), elem_type);
   }
 
-  cv::Mat retimg;
-  if (elem_type == TOONZ_TILE_TYPE_32P) {
-    retimg = cv::Mat(cv::Size(static_cast<int>(std::ceil(rect.width)),
-                              static_cast<int>(std::ceil(rect.height))),
-                     CV_8UC4, cv::Scalar(0, 0, 0, 0));
+  if (subrects.size() <= 1) {
+    compute_rect(fx, cfg, params, rs, frame, elem_type, ports, rect, outrect,
+                 out);
   } else {
-    retimg = cv::Mat(cv::Size(static_cast<int>(std::ceil(rect.width)),
-                              static_cast<int>(std::ceil(rect.height))),
-                     CV_16UC4, cv::Scalar(0, 0, 0, 0));
+    // sub-tiles write disjoint parts of the tile, and compute results only
+    // over them
+    tnzu::parallel_for(static_cast<int>(subrects.size()), 0, [&](int k) {
+      compute_rect(fx, cfg, params, rs, frame, elem_type, ports,
+                   subrects[k], subrects[k], out);
+    });
   }
+}
 
-  fx->compute(cfg, params, args, retimg);
-
-  if (elem_type == TOONZ_TILE_TYPE_32P) {
-    DEBUG_PRINT("INFO output elem_type = TOONZ_TILE_TYPE_32P");
-    if (!from_mat<cv::Vec4b>(tile, bbox, retimg)) {
-      DEBUG_PRINT("WARNING fail copying to the tile");
+// computes the result into a proxy at `proxy` times the resolution of `rs`,
+// and upsamples it to `out`
+void render_proxy(toonz_node_handle_t node, tnzu::Fx* fx,
+                  const toonz_rendering_setting_t* rs, double frame,
+                  int elem_type, double proxy, TileLock const& out) {
+  toonz_rendering_setting_t prs = *rs;
+  prs.affine.a11 *= proxy;
+  prs.affine.a12 *= proxy;
+  prs.affine.a13 *= proxy;
+  prs.affine.a21 *= proxy;
+  prs.affine.a22 *= proxy;
+  prs.affine.a23 *= proxy;
+
+  tnzu::Fx::Config cfg = make_config(&prs, frame);
+  cfg.scale = proxy;
+
+  tnzu::Fx::Params params(fx->param_count());
+  {
+    TNZU_TRACE_SPAN("get_params");
+    if (!get_params(node, fx, frame, params)) {
       return;
     }
-  } else {
-    DEBUG_PRINT("INFO output elem_type = TOONZ_TILE_TYPE_64P");
-    if (!from_mat<cv::Vec4w>(tile, bbox, retimg)) {
-      DEBUG_PRINT("WARNING fail copying to the tile");
-      return;
+  }
+  for (int i = 0; i < fx->param_count(); i++) {
+    if (fx->param_spatial(i)) {
+      params[i] *= proxy;
+    }
+  }
+
+  // the tile in the proxy, and a margin of a pixel for bilinear filtering
+  toonz::rect_t const& rect = out.rect();
+  toonz::rect_t prect;
+  prect.x0 = std::floor(rect.x0 * proxy) - 1.0;
+  prect.y0 = std::floor(rect.y0 * proxy) - 1.0;
+  prect.x1 = std::ceil(rect.x1 * proxy) + 1.0;
+  prect.y1 = std::ceil(rect.y1 * proxy) + 1.0;
+
+  int const type = (elem_type == TOONZ_TILE_TYPE_32P) ? CV_8UC4 : CV_16UC4;
+  cv::Mat img = zeros_pooled(cv::Size(static_cast<int>(prect.x1 - prect.x0),
+                                      static_cast<int>(prect.y1 - prect.y0)),
+                             type);
+  {
+    TileLock const pout(img, prect);
+    render_tile(node, fx, &prs, cfg, frame, elem_type, params, pout);
+  }
+
+  TNZU_TRACE_SPAN("upsample");
+
+  // centers of pixels of the tile in the proxy
+  cv::Matx23d const m(proxy, 0.0, (rect.x0 + 0.5) * proxy - 0.5 - prect.x0,
+                      0.0, proxy, (rect.y0 + 0.5) * proxy - 0.5 - prect.y0);
+
+  cv::Size const size = out.size();
+  cv::Rect2d const bounds = to_rect2d(rect);
+
+  cv::Mat view;
+  bool const direct =
+      (type == CV_8UC4)
+          ? tile_view<cv::Vec4b>(out, bounds, bounds.tl(), size, view)
+          : tile_view<cv::Vec4w>(out, bounds, bounds.tl(), size, view);
+  tnzu::sample_image(img, m, size, view, tnzu::SAMPLE_BORDER_CLAMP,
+                     tnzu::SAMPLE_FILTER_BILINEAR);
+  if (!direct) {
+    if (type == CV_8UC4) {
+      from_mat<cv::Vec4b>(out, bounds, rect, view, nullptr);
+    } else {
+      from_mat<cv::Vec4w>(out, bounds, rect, view, nullptr);
     }
   }
 }
 
-int do_get_bbox(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
-                double frame, toonz_rect_t* bbox) {
+//
+// implementation
+//
+extern "C" {
+
+void do_compute(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
+                double frame, toonz_tile_handle_t tile) {
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
   if (!fx) {
-    return 1;
+    return;
   }
 
-  int const paramc = fx->param_count();
-  tnzu::Fx::Params params(paramc);
-  for (int i = 0; i < paramc; i++) {
-    toonz::param_handle_t param = nullptr;
-    if (int const ret =
-            nodeif->get_param(node, fx->param_prototype(i)->name, &param)) {
-      return 1;
-    }
+  ComputeScope const scope;
+  TNZU_TRACE_SPAN("do_compute");
 
-    int size_in_elements = 1;
-    paramif->get_value(param, frame, &size_in_elements, &params[i]);
+  int elem_type = TOONZ_TILE_TYPE_32P;
+  tileif->get_element_type(tile, &elem_type);
+  if ((elem_type != TOONZ_TILE_TYPE_32P) &&
+      (elem_type != TOONZ_TILE_TYPE_64P)) {
+    TNZU_LOG_WARNING("unsupported pixel format");
+    return;
   }
 
-  bbox->x0 = +std::numeric_limits<double>::infinity();
-  bbox->y0 = +std::numeric_limits<double>::infinity();
-  bbox->x1 = -std::numeric_limits<double>::infinity();
-  bbox->y1 = -std::numeric_limits<double>::infinity();
+  tnzu::Fx::Config const cfg = make_config(rs, frame);
+  TileLock const out(tile);
 
-  for (int i = 0, argc = fx->port_count(); i < argc; i++) {
-    toonz::port_handle_t port = nullptr;
-    nodeif->get_input_port(node, fx->port_name(i), &port);
-    if (!port) {
-      continue;
-    }
+  double const proxy = fx->proxy_scale(cfg);
+  if ((proxy > 0.0) && (proxy < 1.0)) {
+    render_proxy(node, fx, rs, frame, elem_type, proxy, out);
+    return;
+  }
 
-    int con = 0;
-    portif->is_connected(port, &con);
-    if (!con) {
-      continue;
+  tnzu::Fx::Params params(fx->param_count());
+  {
+    TNZU_TRACE_SPAN("get_params");
+    if (!get_params(node, fx, frame, params)) {
+      return;
     }
+  }
 
-    toonz::fxnode_handle_t fx = nullptr;
-    portif->get_fx(port, &fx);
-    if (!fx) {
-      DEBUG_PRINT("WARNING could not get a fx of the port");
-      continue;
-    }
+  render_tile(node, fx, rs, cfg, frame, elem_type, params, out);
+}
 
-    int got = 0;
-    toonz::rect_t inbbox;
-    fxif->get_bbox(fx, rs, frame, &inbbox, &got);
-    if (!got) {
-      continue;
-    }
+int do_get_bbox(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
+                double frame, toonz_rect_t* bbox) {
+  tnzu::Fx* fx = nullptr;
+  nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-    bbox->x0 = std::min(bbox->x0, inbbox.x0);
-    bbox->y0 = std::min(bbox->y0, inbbox.y0);
-    bbox->x1 = std::max(bbox->x1, inbbox.x1);
-    bbox->y1 = std::max(bbox->y1, inbbox.y1);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  if (!fx) {
+    return 1;
   }
 
-  tnzu::Fx::Config const cfg = {
-      rs->affine, rs->gamma, rs->time_stretch_from, rs->time_stretch_to,
-      rs->stereo_scopic_shift, rs->bpp, rs->max_tile_size, rs->quality,
-      rs->field_prevalence, rs->stereoscopic, rs->is_swatch, rs->user_cachable,
-      rs->apply_shrink_to_viewer, static_cast<int>(frame),
-  };
+  tnzu::Fx::Params params(fx->param_count());
+  if (!get_params(node, fx, frame, params)) {
+    return 1;
+  }
 
-  cv::Rect2d rect(bbox->x0, bbox->y0, bbox->x1 - bbox->x0, bbox->y1 - bbox->y0);
-  fx->enlarge(cfg, params, rect);
+  tnzu::Fx::Config const cfg = make_config(rs, frame);
+
+  cv::Rect2d const rect = get_upstream(node, fx, rs, frame, cfg, params).rect;
 
   if ((rect.width <= 0.0) || (rect.height <= 0.0)) {
     return 1;
@@ -672,15 +3378,50 @@ int do_get_bbox(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
 
 int can_handle(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
                double frame) {
-  DEBUG_PRINT(__FUNCTION__);
+  TNZU_LOG_DEBUG(__FUNCTION__);
   return TOONZ_OK;
 }
 
+// in megabytes, cf. TRasterFx::getMemoryRequirement()
 size_t get_memory_requirement(toonz_node_handle_t node,
                               const toonz_rendering_setting_t* rs, double frame,
                               const toonz_rect_t* rect) {
-  DEBUG_PRINT(__FUNCTION__);
-  return 0;
+  tnzu::Fx* fx = nullptr;
+  nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
+
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  if (!fx) {
+    return 0;
+  }
+
+  tnzu::Fx::Params params(fx->param_count());
+  if (!get_params(node, fx, frame, params)) {
+    return 0;
+  }
+
+  tnzu::Fx::Config const cfg = make_config(rs, frame);
+
+  // the area of inputs required for `rect`
+  cv::Rect2d area = to_rect2d(*rect);
+  fx->require(cfg, params, area);
+  if (!is_finite(area)) {
+    toonz_rect_t bbox;
+    area = to_rect2d(*rect);
+    if (!do_get_bbox(node, rs, frame, &bbox) && is_finite(to_rect2d(bbox))) {
+      area = to_rect2d(bbox);
+    }
+  }
+
+  std::size_t bytes = fx->memory_requirement(cfg, params, area);
+  if (fx->use_subtiles() && (cfg.max_tile_size > 0)) {
+    // at most a sub-tile per thread is in flight
+    std::size_t const subtiles =
+        static_cast<std::size_t>(cfg.max_tile_size) * (1 << 20) *
+        (Executor::instance().size() + 1);
+    bytes = std::min(bytes, subtiles);
+  }
+
+  return (bytes + (1 << 20) - 1) >> 20;
 }
 
 void on_new_frame(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
@@ -688,11 +3429,12 @@ void on_new_frame(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
   if (!fx) {
     return;
   }
 
+  fx->state()->frames.begin_frame(node, frame);
   fx->begin_frame();
 }
 
@@ -701,27 +3443,32 @@ void on_end_frame(toonz_node_handle_t node, const toonz_rendering_setting_t* rs,
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
   if (!fx) {
     return;
   }
 
   fx->end_frame();
+  fx->state()->frames.end_frame(node, frame);
 }
 
 int node_create(toonz_node_handle_t node) {
-  DEBUG_PRINT(__FUNCTION__ << " : " << node);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : " << node);
 
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
   if (fx) {
-    DEBUG_PRINT("this is clone");
+    TNZU_LOG_DEBUG("this is clone");
   } else {
     fx = tnzu::make_fx();
     fx->handle() = node;
     nodeif->set_user_data(node, fx);
   }
 
+  if (!fx->state()->frames.resolve(node, fx)) {
+    TNZU_LOG_WARNING("could not get parameters");
+  }
+
   return fx->init();
 }
 
@@ -729,12 +3476,14 @@ int node_destroy(toonz_node_handle_t node) {
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
 
   if (fx && (fx->handle() == node)) {
     nodeif->set_user_data(node, nullptr);
     delete fx;
-    DEBUG_PRINT("release a user_data");
+    TNZU_LOG_DEBUG("release a user_data");
+  } else if (fx) {
+    fx->state()->frames.forget(node);
   }
 
   return TOONZ_OK;
@@ -762,8 +3511,8 @@ int plugin_setup(toonz_node_handle_t dummy) {
   int ret = setup->set_parameter_pages_with_error(
       dummy, 1, const_cast<toonz_param_page_t*>(&pages), &errcode, &entry);
   if (ret) {
-    DEBUG_PRINT("setup error:" << ret << " reason:" << errcode
-                               << " entry:" << entry);
+    TNZU_LOG_ERROR("setup error:" << ret << " reason:" << errcode
+                                  << " entry:" << entry);
   }
 
   // add input ports
@@ -774,15 +3523,19 @@ int plugin_setup(toonz_node_handle_t dummy) {
   return TOONZ_OK;
 }
 
+// nodes between start_render and end_render
+std::atomic<int> renders(0);
+
 int start_render(toonz_node_handle_t node) {
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
   if (!fx) {
     return 1;
   }
 
+  ++renders;
   return fx->begin_render();
 }
 
@@ -790,24 +3543,70 @@ int end_render(toonz_node_handle_t node) {
   tnzu::Fx* fx = nullptr;
   nodeif->get_user_data(node, reinterpret_cast<void**>(&fx));
 
-  DEBUG_PRINT(__FUNCTION__ << " : node=" << node << ", data=" << fx);
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : node=" << node << ", data=" << fx);
   if (!fx) {
     return 1;
   }
 
+  // values of aborted frames
+  fx->state()->frames.clear_values(node);
+  fx->state()->release_blooms();
+  fx->state()->store.clear();
+
+  // buffers are kept while other nodes render
+  if (--renders <= 0) {
+    renders = 0;
+    BufferPool::instance().trim();
+  }
+
   return fx->end_render();
 }
 
 int toonz_plugin_init_main(toonz_host_interface_t* hostif) {
-  DEBUG_PRINT(__FUNCTION__);
+  TNZU_LOG_DEBUG(__FUNCTION__);
   ifactory = hostif;
   TOONZ_SET_IF(nodeif, toonz_node_interface_t, TOONZ_UUID_NODE);
   TOONZ_SET_IF(portif, toonz_port_interface_t, TOONZ_UUID_PORT);
   TOONZ_SET_IF(fxif, toonz_fxnode_interface_t, TOONZ_UUID_FXNODE);
   TOONZ_SET_IF(paramif, toonz_param_interface_t, TOONZ_UUID_PARAM);
   TOONZ_SET_IF(tileif, toonz_tile_interface_t, TOONZ_UUID_TILE);
+
+  if (char const* level = std::getenv("TNZU_LOG_LEVEL")) {
+    tnzu::set_log_level(std::atoi(level));
+  }
+  if (char const* path = std::getenv("TNZU_TRACE")) {
+    tnzu::start_trace(path);
+  }
+
+  if (char const* huge_pages = std::getenv("TNZU_HUGE_PAGES")) {
+    tnzu::set_huge_pages(std::atoi(huge_pages) != 0);
+  }
+
+  select_kernels(std::getenv("TNZU_SIMD"));
+  TNZU_LOG_INFO("SIMD variant : " << tnzu::simd_variant());
   return TOONZ_OK;
 }
 
-void toonz_plugin_exit_main() { DEBUG_PRINT(__FUNCTION__); }
+void toonz_plugin_exit_main() {
+  tnzu::ExecutorStats const executor = tnzu::executor_stats();
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : tasks=" << executor.tasks
+                              << ", steals=" << executor.steals);
+
+  Executor::instance().shutdown();
+
+  // workers are joined, so rings are no longer written
+  std::string const trace = Tracer::instance().stop();
+  if (!trace.empty() && !tnzu::write_trace(trace)) {
+    TNZU_LOG_ERROR("could not write a trace to " << trace);
+  }
+
+  tnzu::TransferStats const stats = tnzu::transfer_stats();
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : copied=" << stats.copied_bytes
+                              << " bytes, aliased=" << stats.aliased_bytes
+                              << " bytes");
+
+  tnzu::CacheStats const cache = tnzu::cache_stats();
+  TNZU_LOG_DEBUG(__FUNCTION__ << " : cache hits=" << cache.hits
+                              << ", misses=" << cache.misses);
+}
 }